@@ -0,0 +1,444 @@
+// Echo Bridge — High-quality convolution reverb for Daisy Seed
+// Copyright (C) 2025  Daniel Ramirez / LUFS Audio
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// echobridge_bench: the reverb engine built for the host, with libDaisy
+// and DaisySP stood in for by stub/. It checks the engine against brute-
+// force direct convolution and ShyFFT against a direct DFT, then times
+// ProcessBlock() across IR lengths and layouts and each FFT size.
+//
+//   echobridge_bench            check, then benchmark
+//   echobridge_bench --check    check only; exit status 1 on a failure
+//   echobridge_bench --bench    benchmark only
+//
+// The engine keeps its state in static buffers, like on the pedal, so
+// every engine case runs in a child process of its own, starting from a
+// freshly booted engine.
+
+#include "PartitionedConvolutionReverb.h"
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+PartitionedConvolutionReverb reverb;
+
+// Largest error allowed, relative to the peak of the reference
+static const double ENGINE_TOLERANCE = 1e-5;
+static const double FFT_TOLERANCE = 1e-5;
+
+// Audio timed per benchmark case, after BENCH_WARMUP_SECONDS to let the
+// IR swap in and the tone fold settle
+static const float BENCH_SECONDS = 10.0f;
+static const float BENCH_WARMUP_SECONDS = 2.0f;
+
+// Samples transformed per FFT size when timing
+static const size_t FFT_BENCH_SAMPLES = 1 << 23;
+
+// By IrLayout
+static const char* const LAYOUT_NAMES[] = {"mono", "stereo", "true-stereo"};
+
+// Test IR: decaying noise. Mono uses ll, stereo ll and rr.
+struct TestIr {
+    std::vector<float> ll, lr, rl, rr;
+    size_t length;
+};
+
+static double NowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Run a case in a child process; true if it returned true
+template <typename Case>
+static bool Isolated(Case run) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        bool ok = run();
+        fflush(stdout);
+        _exit(ok ? 0 : 1);
+    }
+
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+        return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void Noise(std::mt19937& rng, std::vector<float>& buffer, float decaySamples) {
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = uniform(rng) * ((decaySamples > 0.0f) ? expf(-(float)i / decaySamples) : 1.0f);
+    }
+}
+
+static TestIr MakeIr(IrLayout layout, size_t length, uint32_t seed) {
+    std::mt19937 rng(seed);
+    TestIr ir;
+    ir.length = length;
+    std::vector<float>* paths[] = {&ir.ll, &ir.rr, &ir.lr, &ir.rl};
+    size_t count = (layout == IR_LAYOUT_MONO) ? 1 : (layout == IR_LAYOUT_STEREO) ? 2 : 4;
+    for (size_t i = 0; i < count; i++) {
+        paths[i]->resize(length);
+        Noise(rng, *paths[i], length * 0.3f);
+    }
+    return ir;
+}
+
+static bool LoadTestIr(IrLayout layout, TestIr& ir) {
+    bool ok = false;
+    switch (layout) {
+    case IR_LAYOUT_MONO:
+        ok = reverb.LoadIR(0, ir.ll.data(), ir.length);
+        break;
+    case IR_LAYOUT_STEREO:
+        ok = reverb.LoadStereoIR(0, ir.ll.data(), ir.rr.data(), ir.length);
+        break;
+    case IR_LAYOUT_TRUE_STEREO:
+        ok = reverb.LoadTrueStereoIR(0, ir.ll.data(), ir.lr.data(), ir.rl.data(), ir.rr.data(), ir.length);
+        break;
+    }
+    while (ok && !reverb.UpdateIR()) {
+    }
+    return ok;
+}
+
+// The wet filters as the engine sets them up, for the reference
+struct WetFilter {
+    daisysp::Svf lowCut;
+    daisysp::Svf highCut;
+
+    void Init(float sampleRate, float low, float high) {
+        lowCut.Init(sampleRate);
+        highCut.Init(sampleRate);
+        lowCut.SetRes(0.707f);
+        lowCut.SetDrive(0.0f);
+        highCut.SetRes(0.707f);
+        highCut.SetDrive(0.0f);
+        lowCut.SetFreq(low);
+        highCut.SetFreq(high);
+    }
+
+    float Process(float in) {
+        lowCut.Process(in);
+        highCut.Process(lowCut.High());
+        return highCut.Low();
+    }
+};
+
+static double Dot(const std::vector<float>& ir, const std::vector<float>& x, size_t n, size_t length) {
+    double sum = 0.0;
+    for (size_t m = 0; m < length && m <= n; m++) {
+        sum += (double)ir[m] * x[n - m];
+    }
+    return sum;
+}
+
+// Engine output against direct convolution of the same input, delayed by
+// the wet latency and run through the wet filters. The IR reaches two
+// partitions into the last section, so every section contributes.
+static bool CheckEngine(IrLayout layout, bool stereoInput, bool zeroLatency) {
+    const float sampleRate = PROFILE_SAMPLE_RATE;
+    const float lowCut = 100.0f;
+    const float highCut = 10000.0f;
+    size_t length = SECTION_OFFSET_3 + 2 * PARTITION_SIZE_3;
+    size_t frames = length + 8192;
+
+    TestIr ir = MakeIr(layout, length, 1);
+    std::mt19937 rng(2);
+    std::vector<float> inL(frames), inR(frames), outL(frames), outR(frames);
+    Noise(rng, inL, 0.0f);
+    Noise(rng, inR, 0.0f);
+    if (!stereoInput) {
+        inR = inL;
+    }
+
+    // Silence for the first block, while the dry/wet mix ramps to all wet
+    size_t block = PROFILE_BLOCK_SIZE;
+    for (size_t i = 0; i < block; i++) {
+        inL[i] = 0.0f;
+        inR[i] = 0.0f;
+    }
+
+    reverb.SetLowCut(lowCut);
+    reverb.SetHighCut(highCut);
+    reverb.Init(sampleRate);
+    reverb.SetZeroLatency(zeroLatency);
+    reverb.SetDryWet(1.0f);
+    reverb.SetStereoInput(stereoInput);
+    if (!LoadTestIr(layout, ir)) {
+        printf("check %-11s %-6s input, %s: IR load failed\n", LAYOUT_NAMES[layout],
+               stereoInput ? "stereo" : "mono", zeroLatency ? "zero latency" : "latency");
+        return false;
+    }
+
+    size_t processed = 0;
+    for (; processed + block <= frames; processed += block) {
+        const float* in[2] = {&inL[processed], &inR[processed]};
+        float* out[2] = {&outL[processed], &outR[processed]};
+        reverb.ProcessBlock(in, out, block);
+    }
+
+    WetFilter filterL;
+    WetFilter filterR;
+    filterL.Init(sampleRate, lowCut, highCut);
+    filterR.Init(sampleRate, lowCut, highCut);
+
+    const std::vector<float>& hl = ir.ll;
+    const std::vector<float>& hr = (layout == IR_LAYOUT_MONO) ? ir.ll : ir.rr;
+    size_t latency = zeroLatency ? 0 : WET_LATENCY;
+    double peak = 0.0;
+    double error = 0.0;
+    for (size_t t = 0; t < processed; t++) {
+        double yl = 0.0;
+        double yr = 0.0;
+        if (t >= latency) {
+            size_t n = t - latency;
+            yl = Dot(hl, inL, n, length);
+            yr = Dot(hr, inR, n, length);
+            if (layout == IR_LAYOUT_TRUE_STEREO) {
+                yl += Dot(ir.rl, inR, n, length);
+                yr += Dot(ir.lr, inL, n, length);
+            }
+        }
+        yl = filterL.Process((float)yl);
+        yr = filterR.Process((float)yr);
+
+        peak = fmax(peak, fmax(fabs(yl), fabs(yr)));
+        error = fmax(error, fmax(fabs(yl - outL[t]), fabs(yr - outR[t])));
+    }
+
+    double relative = (peak > 0.0) ? error / peak : 1.0;
+    bool ok = relative < ENGINE_TOLERANCE;
+    printf("check %-11s %-6s input, %-12s: error %.2e of peak  %s\n", LAYOUT_NAMES[layout],
+           stereoInput ? "stereo" : "mono", zeroLatency ? "zero latency" : "latency", relative,
+           ok ? "ok" : "FAIL");
+    return ok;
+}
+
+// Forward transform against a direct DFT in double precision, and the
+// inverse against the input
+template <size_t N>
+static bool CheckFft() {
+    const size_t bins = ShyFFT<float, N>::BINS;
+    std::mt19937 rng(3);
+    std::vector<float> input(N), real(bins), imag(bins), output(N);
+    Noise(rng, input, 0.0f);
+
+    ShyFFT<float, N> fft;
+    fft.Direct(input.data(), real.data(), imag.data());
+
+    // Bin k for k in 1..BINS-1; DC in real[0] and Nyquist in imag[0]
+    double peak = 0.0;
+    double error = 0.0;
+    for (size_t k = 0; k <= bins; k++) {
+        double re = 0.0;
+        double im = 0.0;
+        for (size_t n = 0; n < N; n++) {
+            double phase = -2.0 * M_PI * (double)((k * n) % N) / N;
+            re += input[n] * cos(phase);
+            im += input[n] * sin(phase);
+        }
+
+        double gotRe = (k == 0) ? real[0] : (k == bins) ? imag[0] : real[k];
+        double gotIm = (k == 0 || k == bins) ? 0.0 : imag[k];
+        peak = fmax(peak, hypot(re, im));
+        error = fmax(error, hypot(re - gotRe, im - gotIm));
+    }
+
+    fft.Inverse(real.data(), imag.data(), output.data());
+    double roundTrip = 0.0;
+    for (size_t n = 0; n < N; n++) {
+        roundTrip = fmax(roundTrip, fabs(output[n] - input[n]));
+    }
+
+    double relative = error / peak;
+    bool ok = relative < FFT_TOLERANCE && roundTrip < FFT_TOLERANCE;
+    printf("check fft %5zu: error %.2e of peak, round trip %.2e  %s\n", N, relative, roundTrip,
+           ok ? "ok" : "FAIL");
+    return ok;
+}
+
+// ProcessBlock() as the firmware runs it: zero-latency head, filter
+// folding and the profile's tail decimation, with the main loop's
+// UpdateIR() between blocks (not timed)
+static bool BenchEngine(IrLayout layout, bool stereoInput, float seconds) {
+    const float sampleRate = PROFILE_SAMPLE_RATE;
+    size_t length = (size_t)(seconds * sampleRate);
+    if (length > MAX_IR_LENGTH) {
+        length = MAX_IR_LENGTH;
+    }
+
+    TestIr ir = MakeIr(layout, length, 1);
+    std::mt19937 rng(2);
+    size_t block = PROFILE_BLOCK_SIZE;
+    std::vector<float> inL((size_t)sampleRate), inR((size_t)sampleRate), outL(block), outR(block);
+    Noise(rng, inL, 0.0f);
+    Noise(rng, inR, 0.0f);
+    if (!stereoInput) {
+        inR = inL;
+    }
+
+    reverb.Init(sampleRate);
+    reverb.SetZeroLatency(true);
+    reverb.SetFilterFolding(true);
+    reverb.SetTailDecimation(PROFILE_TAIL_DECIMATION);
+    reverb.SetStereoInput(stereoInput);
+    if (!LoadTestIr(layout, ir)) {
+        printf("bench %-11s IR %4.2fs: IR load failed\n", LAYOUT_NAMES[layout], length / sampleRate);
+        return false;
+    }
+
+    size_t warmup = (size_t)(BENCH_WARMUP_SECONDS * sampleRate) / block;
+    size_t blocks = (size_t)(BENCH_SECONDS * sampleRate) / block;
+    size_t pos = 0;
+    double total = 0.0;
+    double worst = 0.0;
+    for (size_t i = 0; i < warmup + blocks; i++) {
+        if (pos + block > inL.size()) {
+            pos = 0;
+        }
+        const float* in[2] = {&inL[pos], &inR[pos]};
+        float* out[2] = {outL.data(), outR.data()};
+        pos += block;
+
+        double start = NowNs();
+        reverb.ProcessBlock(in, out, block);
+        double elapsed = NowNs() - start;
+        reverb.UpdateIR();
+
+        if (i >= warmup) {
+            total += elapsed;
+            worst = fmax(worst, elapsed);
+        }
+    }
+
+    double samplesPerSecond = blocks * block / (total * 1e-9);
+    printf("bench %-11s %-6s input, IR %4.2fs: %8.0f ns/block (worst %8.0f), %6.2f Msamples/s, %6.1fx realtime\n",
+           LAYOUT_NAMES[layout], stereoInput ? "stereo" : "mono", length / sampleRate, total / blocks, worst,
+           samplesPerSecond * 1e-6, samplesPerSecond / sampleRate);
+    return true;
+}
+
+template <size_t N>
+static void BenchFft() {
+    const size_t bins = ShyFFT<float, N>::BINS;
+    std::mt19937 rng(3);
+    std::vector<float> input(N), real(bins), imag(bins), output(N);
+    Noise(rng, input, 0.0f);
+    ShyFFT<float, N> fft;
+    size_t runs = FFT_BENCH_SAMPLES / N;
+
+    // The inverse works in place, so it is timed after a forward transform
+    // each run and the forward time taken off
+    double start = NowNs();
+    for (size_t i = 0; i < runs; i++) {
+        fft.Direct(input.data(), real.data(), imag.data());
+    }
+    double direct = (NowNs() - start) / runs;
+
+    start = NowNs();
+    for (size_t i = 0; i < runs; i++) {
+        fft.Direct(input.data(), real.data(), imag.data());
+        fft.Inverse(real.data(), imag.data(), output.data());
+    }
+    double inverse = (NowNs() - start) / runs - direct;
+
+    printf("bench fft %5zu: direct %8.0f ns, inverse %8.0f ns\n", N, direct, inverse);
+}
+
+static bool Check() {
+    bool ok = true;
+    ok &= CheckFft<64>();
+    ok &= CheckFft<128>();
+    ok &= CheckFft<256>();
+    ok &= CheckFft<512>();
+    ok &= CheckFft<1024>();
+    ok &= CheckFft<2048>();
+    ok &= CheckFft<4096>();
+    ok &= CheckFft<8192>();
+
+    struct EngineCase {
+        IrLayout layout;
+        bool stereoInput;
+    };
+    static const EngineCase cases[] = {
+        {IR_LAYOUT_MONO, false},
+        {IR_LAYOUT_MONO, true},
+        {IR_LAYOUT_STEREO, false},
+        {IR_LAYOUT_STEREO, true},
+        {IR_LAYOUT_TRUE_STEREO, false},
+        {IR_LAYOUT_TRUE_STEREO, true}
+    };
+    for (const EngineCase& c : cases) {
+        for (int zeroLatency = 0; zeroLatency < 2; zeroLatency++) {
+            ok &= Isolated([&] { return CheckEngine(c.layout, c.stereoInput, zeroLatency != 0); });
+        }
+    }
+    return ok;
+}
+
+static void Bench() {
+    static const float IR_SECONDS[] = {0.5f, 1.0f, 2.0f, 4.0f};
+    for (float seconds : IR_SECONDS) {
+        Isolated([&] { return BenchEngine(IR_LAYOUT_MONO, false, seconds); });
+        Isolated([&] { return BenchEngine(IR_LAYOUT_STEREO, true, seconds); });
+        Isolated([&] { return BenchEngine(IR_LAYOUT_TRUE_STEREO, true, seconds); });
+    }
+
+    BenchFft<64>();
+    BenchFft<128>();
+    BenchFft<256>();
+    BenchFft<512>();
+    BenchFft<1024>();
+    BenchFft<2048>();
+    BenchFft<4096>();
+    BenchFft<8192>();
+}
+
+int main(int argc, char** argv) {
+    bool check = true;
+    bool bench = true;
+    if (argc > 1 && strcmp(argv[1], "--check") == 0) {
+        bench = false;
+    } else if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        check = false;
+    } else if (argc > 1) {
+        fprintf(stderr, "usage: %s [--check | --bench]\n", argv[0]);
+        return 2;
+    }
+
+    printf("%u Hz, %zu-sample blocks, partitions %zu/%zu/%zu/%zu, tail decimation %zu\n",
+           (unsigned)PROFILE_SAMPLE_RATE, PROFILE_BLOCK_SIZE, PARTITION_SIZE_0, PARTITION_SIZE_1,
+           PARTITION_SIZE_2, PARTITION_SIZE_3, PROFILE_TAIL_DECIMATION);
+
+    bool ok = true;
+    if (check) {
+        ok = Check();
+        printf("%s\n", ok ? "all checks passed" : "CHECKS FAILED");
+    }
+    if (bench) {
+        Bench();
+    }
+    return ok ? 0 : 1;
+}
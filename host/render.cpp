@@ -0,0 +1,479 @@
+// Echo Bridge — High-quality convolution reverb for Daisy Seed
+// Copyright (C) 2025  Daniel Ramirez / LUFS Audio
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+// echobridge_render: offline renders of input WAV files through the reverb
+// engine, to audition IRs without the pedal. Every IR is loaded by the
+// firmware's IRLoader (decoding, layout by channel count, tail trimming and
+// normalization as from a USB drive) and rendered with the firmware's
+// engine settings, so a render sounds like the pedal does.
+//
+//   echobridge_render [options] -o DIR IR... -i INPUT...
+//
+// Each IR x input pair is written to DIR/<ir>__<input>.wav as 32-bit float
+// stereo. The input is streamed through in chunks, followed by the reverb
+// tail. The engine keeps its state in static buffers, like on the pedal,
+// so pairs render in parallel as worker processes, one engine each.
+
+#include "PartitionedConvolutionReverb.h"
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+PartitionedConvolutionReverb reverb;
+IRLoader irLoader;
+
+// Frames read from the input per chunk, a whole number of audio blocks
+static const size_t RENDER_CHUNK = 4096 / PROFILE_BLOCK_SIZE * PROFILE_BLOCK_SIZE;
+
+struct RenderSettings {
+    float mix;
+    float predelayMs;
+    float lowCut;
+    float highCut;
+    float width;
+    float lengthFactor;
+    float trimDb;
+    float tailSeconds;      // < 0: the IR length plus the predelay
+};
+
+struct RenderJob {
+    std::string ir;         // Absolute paths
+    std::string input;
+    std::string output;
+};
+
+// Length of the IR the loader published, for the tail
+static size_t g_loadedLength = 0;
+
+static bool ClearIRSlotsCallback() {
+    return reverb.ClearIRSlots();
+}
+
+static bool LoadIRCallback(size_t slot, float* bufferL, float* bufferR, size_t length) {
+    g_loadedLength = length;
+    if (bufferR) {
+        return reverb.LoadStereoIR(slot, bufferL, bufferR, length);
+    }
+    return reverb.LoadIR(slot, bufferL, length);
+}
+
+static bool LoadTrueStereoIRCallback(size_t slot, float* ll, float* lr, float* rl, float* rr, size_t length) {
+    g_loadedLength = length;
+    return reverb.LoadTrueStereoIR(slot, ll, lr, rl, rr, length);
+}
+
+static bool LoadPrecomputedIRCallback(size_t slot, const EbirHeader& header, float* const* paths) {
+    g_loadedLength = header.length;
+    return reverb.LoadPrecomputedIR(slot, header, paths);
+}
+
+static EbirStatus ImportPrecomputedIRCallback(EbirReadFn read, void* context) {
+    return reverb.ImportPrecomputedIR(read, context);
+}
+
+// File name without directory and extension
+static std::string BaseName(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    return (dot == std::string::npos || dot == 0) ? name : name.substr(0, dot);
+}
+
+static std::string Extension(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || path.find('/', dot) != std::string::npos) {
+        return "";
+    }
+    std::string extension = path.substr(dot);
+    for (char& c : extension) {
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+    }
+    return extension;
+}
+
+// Load the IR as the pedal loads an IR from its drive's irs directory: the
+// current directory stands in for the drive (see stub/daisy_seed.h), so
+// the IR is linked into a scratch one
+static bool LoadRenderIR(const std::string& ir, float trimDb) {
+    std::string extension = Extension(ir);
+    if (extension != ".wav" && extension != ".ebir") {
+        fprintf(stderr, "%s: not a .wav or .ebir file\n", ir.c_str());
+        return false;
+    }
+
+    char drive[] = "/tmp/echobridge_render.XXXXXX";
+    if (!mkdtemp(drive)) {
+        fprintf(stderr, "scratch directory: %s\n", strerror(errno));
+        return false;
+    }
+    std::string link = std::string(drive) + "/" + IR_DIRECTORY + "/ir" + extension;
+    bool ok = chdir(drive) == 0 && mkdir(IR_DIRECTORY, 0700) == 0 && symlink(ir.c_str(), link.c_str()) == 0;
+
+    if (ok) {
+        IRLoader::ClearIRSlotsCallback = ClearIRSlotsCallback;
+        IRLoader::LoadIRCallback = LoadIRCallback;
+        IRLoader::LoadTrueStereoIRCallback = LoadTrueStereoIRCallback;
+        IRLoader::LoadPrecomputedIRCallback = LoadPrecomputedIRCallback;
+        IRLoader::ImportPrecomputedIRCallback = ImportPrecomputedIRCallback;
+        irLoader.SetTrimThreshold(trimDb);
+        irLoader.Init();
+
+        // The main loop's order: a loader slice, then an IR update
+        IRLoader::LoadResult result = IRLoader::LOAD_NONE;
+        bool settled = false;
+        while (result == IRLoader::LOAD_NONE || !settled) {
+            irLoader.Process();
+            settled = reverb.UpdateIR();
+            if (result == IRLoader::LOAD_NONE) {
+                result = irLoader.TakeResult();
+            }
+        }
+        ok = result == IRLoader::LOAD_OK;
+        if (!ok) {
+            fprintf(stderr, "%s: IR load failed\n", ir.c_str());
+        }
+    }
+
+    unlink(link.c_str());
+    rmdir((std::string(drive) + "/" + IR_DIRECTORY).c_str());
+    rmdir(drive);
+    return ok;
+}
+
+// 32-bit float stereo WAV, sizes filled in by Close()
+class WavWriter {
+public:
+    WavWriter() : file_(nullptr), frames_(0) {}
+
+    bool Open(const char* path, uint32_t sampleRate) {
+        file_ = fopen(path, "wb");
+        if (!file_) {
+            return false;
+        }
+        frames_ = 0;
+        return WriteHeader(sampleRate);
+    }
+
+    bool Write(const float* left, const float* right, size_t frames) {
+        float interleaved[2 * RENDER_CHUNK];
+        for (size_t start = 0; start < frames; start += RENDER_CHUNK) {
+            size_t n = (frames - start < RENDER_CHUNK) ? frames - start : RENDER_CHUNK;
+            for (size_t i = 0; i < n; i++) {
+                interleaved[2 * i] = left[start + i];
+                interleaved[2 * i + 1] = right[start + i];
+            }
+            if (fwrite(interleaved, sizeof(float), 2 * n, file_) != 2 * n) {
+                return false;
+            }
+        }
+        frames_ += (uint32_t)frames;
+        return true;
+    }
+
+    bool Close(uint32_t sampleRate) {
+        bool ok = fseek(file_, 0, SEEK_SET) == 0 && WriteHeader(sampleRate);
+        return (fclose(file_) == 0) && ok;
+    }
+
+private:
+    FILE* file_;
+    uint32_t frames_;
+
+    static void Le16(uint8_t* p, uint16_t value) {
+        p[0] = (uint8_t)value;
+        p[1] = (uint8_t)(value >> 8);
+    }
+
+    static void Le32(uint8_t* p, uint32_t value) {
+        Le16(p, (uint16_t)value);
+        Le16(p + 2, (uint16_t)(value >> 16));
+    }
+
+    // RIFF, fmt (IEEE float), fact and data chunk headers
+    bool WriteHeader(uint32_t sampleRate) {
+        uint8_t header[58];
+        uint32_t dataBytes = frames_ * 2 * sizeof(float);
+        memcpy(header, "RIFF", 4);
+        Le32(header + 4, sizeof(header) - 8 + dataBytes);
+        memcpy(header + 8, "WAVEfmt ", 8);
+        Le32(header + 16, 18);
+        Le16(header + 20, WavReader::FORMAT_FLOAT);
+        Le16(header + 22, 2);
+        Le32(header + 24, sampleRate);
+        Le32(header + 28, sampleRate * 2 * sizeof(float));
+        Le16(header + 32, 2 * sizeof(float));
+        Le16(header + 34, 32);
+        Le16(header + 36, 0);
+        memcpy(header + 38, "fact", 4);
+        Le32(header + 42, 4);
+        Le32(header + 46, frames_);
+        memcpy(header + 50, "data", 4);
+        Le32(header + 54, dataBytes);
+        return fwrite(header, 1, sizeof(header), file_) == sizeof(header);
+    }
+};
+
+// Render one IR x input pair; runs in its own worker process
+static bool Render(const RenderJob& job, const RenderSettings& settings) {
+    const float sampleRate = PROFILE_SAMPLE_RATE;
+
+    // The firmware's engine setup, with the knobs at the given settings
+    reverb.SetDryWet(settings.mix);
+    reverb.SetPredelay(settings.predelayMs);
+    reverb.SetLowCut(settings.lowCut);
+    reverb.SetHighCut(settings.highCut);
+    reverb.SetStereoWidth(settings.width);
+    reverb.SetIRLengthFactor(settings.lengthFactor);
+    reverb.Init(sampleRate);
+    reverb.SetZeroLatency(true);
+    reverb.SetFilterFolding(true);
+    reverb.SetTailDecimation(PROFILE_TAIL_DECIMATION);
+    if (!LoadRenderIR(job.ir, settings.trimDb)) {
+        return false;
+    }
+
+    FIL file;
+    WavReader wav;
+    if (f_open(&file, job.input.c_str(), FA_READ) != FR_OK || !wav.Open(&file)) {
+        fprintf(stderr, "%s: not a supported WAV file\n", job.input.c_str());
+        return false;
+    }
+    if (wav.SampleRate() != PROFILE_SAMPLE_RATE) {
+        fprintf(stderr, "%s: %u Hz, the engine runs at %u Hz\n", job.input.c_str(),
+                (unsigned)wav.SampleRate(), (unsigned)PROFILE_SAMPLE_RATE);
+        f_close(&file);
+        return false;
+    }
+
+    WavWriter writer;
+    if (!writer.Open(job.output.c_str(), PROFILE_SAMPLE_RATE)) {
+        fprintf(stderr, "%s: %s\n", job.output.c_str(), strerror(errno));
+        f_close(&file);
+        return false;
+    }
+
+    // Mono input shares one convolution between both channels, as with
+    // the pedal's stereo detection; more than two channels are mixed down
+    bool stereo = wav.Channels() == 2;
+    reverb.SetStereoInput(stereo);
+
+    float tailSeconds = settings.tailSeconds;
+    if (tailSeconds < 0.0f) {
+        tailSeconds = g_loadedLength * settings.lengthFactor / sampleRate + settings.predelayMs * 0.001f;
+    }
+    size_t inputFrames = wav.Frames();
+    size_t totalFrames = inputFrames + (size_t)(tailSeconds * sampleRate);
+
+    std::vector<float> inL(RENDER_CHUNK), inR(RENDER_CHUNK), outL(RENDER_CHUNK), outR(RENDER_CHUNK);
+    bool ok = true;
+    for (size_t pos = 0; ok && pos < totalFrames; pos += RENDER_CHUNK) {
+        size_t frames = (totalFrames - pos < RENDER_CHUNK) ? totalFrames - pos : RENDER_CHUNK;
+
+        // Input, then silence for the tail
+        size_t read = (pos < inputFrames) ? inputFrames - pos : 0;
+        if (read > frames) read = frames;
+        if (read > 0) {
+            float* outs[2] = {inL.data(), inR.data()};
+            if (stereo) {
+                ok = wav.Read(outs, 0, 2, (uint32_t)read);
+            } else if (wav.Channels() == 1) {
+                ok = wav.Read(outs, 0, 1, (uint32_t)read);
+            } else {
+                ok = wav.ReadMixed(outs[0], (uint32_t)read);
+            }
+            if (!stereo) {
+                memcpy(inR.data(), inL.data(), read * sizeof(float));
+            }
+        }
+        memset(&inL[read], 0, (RENDER_CHUNK - read) * sizeof(float));
+        memset(&inR[read], 0, (RENDER_CHUNK - read) * sizeof(float));
+
+        // Audio callbacks of the profile's block size, the main loop's IR
+        // update between them; a short last block is padded
+        for (size_t block = 0; block < frames; block += PROFILE_BLOCK_SIZE) {
+            const float* in[2] = {&inL[block], &inR[block]};
+            float* out[2] = {&outL[block], &outR[block]};
+            reverb.ProcessBlock(in, out, PROFILE_BLOCK_SIZE);
+            reverb.UpdateIR();
+        }
+
+        ok = ok && writer.Write(outL.data(), outR.data(), frames);
+    }
+
+    f_close(&file);
+    ok = writer.Close(PROFILE_SAMPLE_RATE) && ok;
+    if (!ok) {
+        fprintf(stderr, "%s: render failed\n", job.output.c_str());
+        unlink(job.output.c_str());
+    }
+    return ok;
+}
+
+static void Usage(const char* name) {
+    fprintf(stderr,
+            "usage: %s [options] -o DIR IR... -i INPUT...\n"
+            "  -o, --output DIR       write DIR/<ir>__<input>.wav\n"
+            "  -h, --help             show this help\n"
+            "  -i, --input            the remaining files are inputs\n"
+            "  -j, --jobs N           renders in parallel (default: one per core)\n"
+            "      --mix X            dry/wet, 0 to 1 (default 0.5)\n"
+            "      --predelay MS      predelay (default 0)\n"
+            "      --low-cut HZ       wet low cut (default 100)\n"
+            "      --high-cut HZ      wet high cut (default 10000)\n"
+            "      --width X          stereo width, 0 to 2 (default 1)\n"
+            "      --length X         IR length factor, 0 to 1 (default 1)\n"
+            "      --trim DB          IR tail trim level, 0 keeps the whole IR (default %.0f)\n"
+            "      --tail SECONDS     silence rendered after the input (default: IR length + predelay)\n",
+            name, IR_TRIM_THRESHOLD_DB);
+}
+
+static std::string AbsolutePath(const char* path) {
+    char resolved[PATH_MAX];
+    return realpath(path, resolved) ? std::string(resolved) : std::string();
+}
+
+int main(int argc, char** argv) {
+    RenderSettings settings = {0.5f, 0.0f, 100.0f, 10000.0f, 1.0f, 1.0f, IR_TRIM_THRESHOLD_DB, -1.0f};
+    const char* outputDir = nullptr;
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    enum {
+        OPT_MIX = 256,
+        OPT_PREDELAY,
+        OPT_LOW_CUT,
+        OPT_HIGH_CUT,
+        OPT_WIDTH,
+        OPT_LENGTH,
+        OPT_TRIM,
+        OPT_TAIL
+    };
+    static const option options[] = {
+        {"output", required_argument, nullptr, 'o'},
+        {"input", no_argument, nullptr, 'i'},
+        {"jobs", required_argument, nullptr, 'j'},
+        {"mix", required_argument, nullptr, OPT_MIX},
+        {"predelay", required_argument, nullptr, OPT_PREDELAY},
+        {"low-cut", required_argument, nullptr, OPT_LOW_CUT},
+        {"high-cut", required_argument, nullptr, OPT_HIGH_CUT},
+        {"width", required_argument, nullptr, OPT_WIDTH},
+        {"length", required_argument, nullptr, OPT_LENGTH},
+        {"trim", required_argument, nullptr, OPT_TRIM},
+        {"tail", required_argument, nullptr, OPT_TAIL},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0}
+    };
+
+    // Files before -i are IRs, files after it inputs
+    std::vector<std::string> irs, inputs;
+    bool inputList = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "-o:ij:h", options, nullptr)) != -1) {
+        switch (opt) {
+        case 1: (inputList ? inputs : irs).push_back(optarg); break;
+        case 'o': outputDir = optarg; break;
+        case 'i': inputList = true; break;
+        case 'j': jobs = atol(optarg); break;
+        case OPT_MIX: settings.mix = atof(optarg); break;
+        case OPT_PREDELAY: settings.predelayMs = atof(optarg); break;
+        case OPT_LOW_CUT: settings.lowCut = atof(optarg); break;
+        case OPT_HIGH_CUT: settings.highCut = atof(optarg); break;
+        case OPT_WIDTH: settings.width = atof(optarg); break;
+        case OPT_LENGTH: settings.lengthFactor = atof(optarg); break;
+        case OPT_TRIM: settings.trimDb = atof(optarg); break;
+        case OPT_TAIL: settings.tailSeconds = atof(optarg); break;
+        case 'h': Usage(argv[0]); return 0;
+        default: Usage(argv[0]); return 2;
+        }
+    }
+    if (!outputDir || irs.empty() || inputs.empty() || jobs < 1) {
+        Usage(argv[0]);
+        return 2;
+    }
+
+    mkdir(outputDir, 0755);
+    std::string output = AbsolutePath(outputDir);
+    if (output.empty()) {
+        fprintf(stderr, "%s: %s\n", outputDir, strerror(errno));
+        return 1;
+    }
+
+    // Workers change directory, so every path is made absolute first
+    std::vector<RenderJob> queue;
+    for (const std::string& ir : irs) {
+        for (const std::string& input : inputs) {
+            RenderJob job;
+            job.ir = AbsolutePath(ir.c_str());
+            job.input = AbsolutePath(input.c_str());
+            job.output = output + "/" + BaseName(ir) + "__" + BaseName(input) + ".wav";
+            if (job.ir.empty() || job.input.empty()) {
+                fprintf(stderr, "%s: not found\n", job.ir.empty() ? ir.c_str() : input.c_str());
+                return 1;
+            }
+            queue.push_back(job);
+        }
+    }
+
+    // Keep up to jobs workers busy; each reports when it exits
+    std::vector<pid_t> workers(queue.size(), -1);
+    size_t next = 0;
+    size_t running = 0;
+    size_t failed = 0;
+    while (next < queue.size() || running > 0) {
+        if (next < queue.size() && running < (size_t)jobs) {
+            fflush(stdout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                _exit(Render(queue[next], settings) ? 0 : 1);
+            }
+            if (pid < 0) {
+                fprintf(stderr, "fork: %s\n", strerror(errno));
+                failed++;
+            } else {
+                workers[next] = pid;
+                running++;
+            }
+            next++;
+            continue;
+        }
+
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0) {
+            break;
+        }
+        for (size_t i = 0; i < queue.size(); i++) {
+            if (workers[i] != pid) {
+                continue;
+            }
+            bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            printf("%s  %s\n", ok ? "ok    " : "FAILED", queue[i].output.c_str());
+            failed += ok ? 0 : 1;
+            running--;
+        }
+    }
+
+    printf("%zu of %zu renders done\n", queue.size() - failed, queue.size());
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,28 @@
+// Echo Bridge — High-quality convolution reverb for Daisy Seed
+// Copyright (C) 2025  Daniel Ramirez / LUFS Audio
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+// Host stand-in for libDaisy's daisy_core.h: the memory section macros
+// place nothing, so the engine's buffers are ordinary statics
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define DSY_SDRAM_BSS
+#define DTCM_MEM_SECTION
+#define DMA_BUFFER_MEM_SECTION
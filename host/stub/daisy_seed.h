@@ -0,0 +1,197 @@
+// Echo Bridge — High-quality convolution reverb for Daisy Seed
+// Copyright (C) 2025  Daniel Ramirez / LUFS Audio
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+// Host stand-in for libDaisy's daisy_seed.h, covering what the engine's
+// headers use: the FatFs calls the WAV reader and the IR loader make,
+// mapped onto stdio and POSIX directories, and a USB host whose drive is
+// the current directory, there from the first Process() on
+
+#include "daisy_core.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef unsigned int UINT;
+typedef unsigned long FSIZE_t;
+
+enum FRESULT {
+    FR_OK = 0,
+    FR_DISK_ERR,
+    FR_NO_FILE
+};
+
+#define FA_READ 0x01
+#define FA_WRITE 0x02
+#define FA_CREATE_ALWAYS 0x08
+
+#define AM_DIR 0x10
+
+struct FIL {
+    FILE* file;
+};
+
+struct FILINFO {
+    FSIZE_t fsize;
+    uint16_t fdate;
+    uint16_t ftime;
+    uint8_t fattrib;
+    char fname[256];
+};
+
+// FatFs and POSIX both name their directory handle DIR
+typedef DIR PosixDir;
+
+struct FatDir {
+    PosixDir* dir;
+    char path[256];
+};
+#define DIR FatDir
+
+inline FRESULT f_mount(void*, const char*, int) {
+    return FR_OK;
+}
+
+inline FRESULT f_open(FIL* fp, const char* path, int mode) {
+    fp->file = fopen(path, (mode & FA_WRITE) ? "wb" : "rb");
+    return fp->file ? FR_OK : FR_NO_FILE;
+}
+
+inline FRESULT f_close(FIL* fp) {
+    return fclose(fp->file) == 0 ? FR_OK : FR_DISK_ERR;
+}
+
+inline FRESULT f_read(FIL* fp, void* buffer, UINT bytes, UINT* bytesRead) {
+    *bytesRead = (UINT)fread(buffer, 1, bytes, fp->file);
+    return ferror(fp->file) ? FR_DISK_ERR : FR_OK;
+}
+
+inline FRESULT f_write(FIL* fp, const void* buffer, UINT bytes, UINT* bytesWritten) {
+    *bytesWritten = (UINT)fwrite(buffer, 1, bytes, fp->file);
+    return ferror(fp->file) ? FR_DISK_ERR : FR_OK;
+}
+
+inline FRESULT f_lseek(FIL* fp, FSIZE_t offset) {
+    return fseek(fp->file, (long)offset, SEEK_SET) == 0 ? FR_OK : FR_DISK_ERR;
+}
+
+inline FSIZE_t f_tell(FIL* fp) {
+    return (FSIZE_t)ftell(fp->file);
+}
+
+inline FSIZE_t f_size(FIL* fp) {
+    struct stat st;
+    return fstat(fileno(fp->file), &st) == 0 ? (FSIZE_t)st.st_size : 0;
+}
+
+// The timestamp is packed into fdate/ftime; only equality is ever tested
+inline FRESULT f_stat(const char* path, FILINFO* info) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return FR_NO_FILE;
+    }
+    info->fsize = (FSIZE_t)st.st_size;
+    info->fdate = (uint16_t)(st.st_mtime >> 16);
+    info->ftime = (uint16_t)st.st_mtime;
+    info->fattrib = S_ISDIR(st.st_mode) ? AM_DIR : 0;
+    return FR_OK;
+}
+
+inline FRESULT f_unlink(const char* path) {
+    return unlink(path) == 0 ? FR_OK : FR_NO_FILE;
+}
+
+inline FRESULT f_opendir(DIR* dp, const char* path) {
+    dp->dir = opendir(path);
+    snprintf(dp->path, sizeof(dp->path), "%s", path);
+    return dp->dir ? FR_OK : FR_NO_FILE;
+}
+
+inline FRESULT f_closedir(DIR* dp) {
+    return closedir(dp->dir) == 0 ? FR_OK : FR_DISK_ERR;
+}
+
+// Like FatFs, an empty fname marks the end of the directory
+inline FRESULT f_readdir(DIR* dp, FILINFO* info) {
+    struct dirent* entry;
+    do {
+        entry = readdir(dp->dir);
+    } while (entry && entry->d_name[0] == '.');
+
+    info->fname[0] = 0;
+    if (!entry) {
+        return FR_OK;
+    }
+    snprintf(info->fname, sizeof(info->fname), "%s", entry->d_name);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dp->path, entry->d_name);
+    FILINFO st;
+    info->fattrib = (f_stat(path, &st) == FR_OK) ? st.fattrib : 0;
+    return FR_OK;
+}
+
+namespace daisy {
+
+class USBHostHandle {
+public:
+    struct Config {
+        void (*connect_callback)(void*) = nullptr;
+        void (*disconnect_callback)(void*) = nullptr;
+        void (*class_active_callback)(void*) = nullptr;
+        void (*error_callback)(void*) = nullptr;
+        void* userdata = nullptr;
+    };
+
+    void Init(Config& config) {
+        config_ = config;
+        connected_ = false;
+    }
+
+    void Process() {
+        if (!connected_ && config_.class_active_callback) {
+            connected_ = true;
+            config_.class_active_callback(config_.userdata);
+        }
+    }
+
+private:
+    Config config_;
+    bool connected_;
+};
+
+class FatFSInterface {
+public:
+    struct Config {
+        enum Media {
+            MEDIA_SD = 1,
+            MEDIA_USB = 2
+        };
+    };
+
+    void Init(int) {}
+    int& GetUSBFileSystem() { return fs_; }
+    const char* GetUSBPath() { return ""; }
+
+private:
+    int fs_;
+};
+
+} // namespace daisy
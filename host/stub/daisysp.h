@@ -0,0 +1,107 @@
+// Echo Bridge — High-quality convolution reverb for Daisy Seed
+// Copyright (C) 2025  Daniel Ramirez / LUFS Audio
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+// Host stand-in for DaisySP. Only Svf is used by the engine; this is the
+// same double-sampled Chamberlin state variable filter as daisysp::Svf
+// (DaisySP, MIT license), so host renders filter like the pedal does.
+
+#include <math.h>
+
+namespace daisysp {
+
+class Svf {
+public:
+    void Init(float sample_rate) {
+        sr_ = sample_rate;
+        fc_ = 200.0f;
+        res_ = 0.5f;
+        drive_ = 0.5f;
+        pre_drive_ = 0.5f;
+        freq_ = 0.25f;
+        damp_ = 0.0f;
+        notch_ = low_ = high_ = band_ = peak_ = 0.0f;
+        input_ = 0.0f;
+        out_notch_ = out_low_ = out_high_ = out_band_ = out_peak_ = 0.0f;
+        fc_max_ = sr_ / 3.0f;
+    }
+
+    void Process(float in) {
+        input_ = in;
+
+        // First pass
+        notch_ = input_ - damp_ * band_;
+        low_ = low_ + freq_ * band_;
+        high_ = notch_ - low_;
+        band_ = freq_ * high_ + band_ - drive_ * band_ * band_ * band_;
+        out_low_ = 0.5f * low_;
+        out_high_ = 0.5f * high_;
+        out_band_ = 0.5f * band_;
+        out_peak_ = 0.5f * (low_ - high_);
+        out_notch_ = 0.5f * notch_;
+
+        // Second pass
+        notch_ = input_ - damp_ * band_;
+        low_ = low_ + freq_ * band_;
+        high_ = notch_ - low_;
+        band_ = freq_ * high_ + band_ - drive_ * band_ * band_ * band_;
+        out_low_ += 0.5f * low_;
+        out_high_ += 0.5f * high_;
+        out_band_ += 0.5f * band_;
+        out_peak_ += 0.5f * (low_ - high_);
+        out_notch_ += 0.5f * notch_;
+    }
+
+    void SetFreq(float f) {
+        fc_ = Clamp(f, 1.0e-6f, fc_max_);
+        freq_ = 2.0f * sinf((float)M_PI * fminf(0.25f, fc_ / (sr_ * 2.0f)));
+        UpdateDamp();
+    }
+
+    void SetRes(float r) {
+        res_ = Clamp(r, 0.0f, 1.0f);
+        UpdateDamp();
+        drive_ = pre_drive_ * res_;
+    }
+
+    void SetDrive(float d) {
+        pre_drive_ = Clamp(d * 0.1f, 0.0f, 1.0f);
+        drive_ = pre_drive_ * res_;
+    }
+
+    float Low() { return out_low_; }
+    float High() { return out_high_; }
+    float Band() { return out_band_; }
+    float Notch() { return out_notch_; }
+    float Peak() { return out_peak_; }
+
+private:
+    float sr_, fc_, res_, drive_, pre_drive_, freq_, damp_, fc_max_;
+    float notch_, low_, high_, band_, peak_, input_;
+    float out_low_, out_high_, out_band_, out_peak_, out_notch_;
+
+    static float Clamp(float x, float lo, float hi) {
+        return (x < lo) ? lo : (x > hi) ? hi : x;
+    }
+
+    void UpdateDamp() {
+        damp_ = fminf(2.0f * (1.0f - powf(res_, 0.25f)), fminf(2.0f, 2.0f / freq_ - freq_ * 0.5f));
+    }
+};
+
+} // namespace daisysp
@@ -0,0 +1,70 @@
+// Echo Bridge — High-quality convolution reverb for Daisy Seed
+// Copyright (C) 2025  Daniel Ramirez / LUFS Audio
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Build profiles, trading latency against CPU headroom. A profile sets the
+// hardware block size and the partition ladder together, so pick one at
+// build time: `make ECHO_PROFILE=LOW_LATENCY` (or BALANCED, LONG_IR), plus
+// `ECHO_96K=1` for 96kHz. The partition layout sizes the section storage
+// at compile time, so changing profile means a rebuild and reflash.
+//
+//   LOW_LATENCY - 16-sample blocks, 32/128-sample head partitions
+//   BALANCED    - 48-sample blocks, 64/256 (the default)
+//   LONG_IR     - 128-sample blocks, 128/256 and the late tail at half rate
+//
+// Sections 2 and 3 keep 1024 and 4096-sample partitions in every profile,
+// and each ladder spends the same memory on section 0/1 spectra as the
+// default. At 96kHz the IR slots hold half as many seconds.
+#define ECHO_PROFILE_LOW_LATENCY 1
+#define ECHO_PROFILE_BALANCED 2
+#define ECHO_PROFILE_LONG_IR 3
+
+#ifndef ECHO_PROFILE
+#define ECHO_PROFILE ECHO_PROFILE_BALANCED
+#endif
+
+#if ECHO_PROFILE == ECHO_PROFILE_LOW_LATENCY
+static const size_t PROFILE_BLOCK_SIZE = 16;
+static const size_t PROFILE_PARTITION_0 = 32;
+static const size_t PROFILE_PARTITION_1 = 128;
+static const size_t PROFILE_TAIL_DECIMATION = 1;
+#elif ECHO_PROFILE == ECHO_PROFILE_BALANCED
+static const size_t PROFILE_BLOCK_SIZE = 48;
+static const size_t PROFILE_PARTITION_0 = 64;
+static const size_t PROFILE_PARTITION_1 = 256;
+static const size_t PROFILE_TAIL_DECIMATION = 1;
+#elif ECHO_PROFILE == ECHO_PROFILE_LONG_IR
+static const size_t PROFILE_BLOCK_SIZE = 128;
+static const size_t PROFILE_PARTITION_0 = 128;
+static const size_t PROFILE_PARTITION_1 = 256;
+static const size_t PROFILE_TAIL_DECIMATION = 2;
+#else
+#error "Unknown ECHO_PROFILE"
+#endif
+
+static const size_t PROFILE_PARTITION_2 = 1024;
+static const size_t PROFILE_PARTITION_3 = 4096;
+
+#ifdef ECHO_96K
+static const uint32_t PROFILE_SAMPLE_RATE = 96000;
+#else
+static const uint32_t PROFILE_SAMPLE_RATE = 48000;
+#endif
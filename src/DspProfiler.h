@@ -0,0 +1,199 @@
+// Echo Bridge — High-quality convolution reverb for Daisy Seed
+// Copyright (C) 2025  Daniel Ramirez / LUFS Audio
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-stage DSP profiler, compiled in with ECHO_PROFILER (`make
+// ECHO_PROFILER=1`). Without it every call below is an empty inline and the
+// release build carries none of it.
+//
+// The audio path marks stage boundaries with DspLap(stage), which charges
+// the cycles since the previous lap to that stage, so one counter read
+// covers both the end of one stage and the start of the next. Each callback
+// sums its chunks per stage; per reporting window the profiler keeps the
+// min/avg/max of those per-callback sums and of the whole callback, and
+// counts callbacks that ran past their block's deadline.
+enum DspStage {
+    DSP_STAGE_PREDELAY,     // Bypass send, predelay, section input and decimation
+    DSP_STAGE_FIR_HEAD,     // Zero-latency FIR head
+    DSP_STAGE_SECTION_0,    // Section jobs: FFTs and multiply-accumulates
+    DSP_STAGE_SECTION_1,
+    DSP_STAGE_SECTION_2,
+    DSP_STAGE_SECTION_3,    // Or the multirate tail
+    DSP_STAGE_WET,          // Wet ring reads, cutoff glide and filters
+    DSP_STAGE_FREEZE,       // Spectral freeze
+    DSP_STAGE_MIX,          // DSP gate, width and dry/wet
+    DSP_STAGES
+};
+
+static const char* const DSP_STAGE_NAMES[DSP_STAGES] = {
+    "predelay", "fir", "sec0", "sec1", "sec2", "sec3", "wet", "freeze", "mix"
+};
+
+#ifdef ECHO_PROFILER
+
+#if defined(__arm__)
+#include "daisy_seed.h"
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Cycle counter: the Cortex-M7 DWT on the target, the TSC on a host
+inline uint32_t DspCycles() {
+#if defined(__arm__)
+    return DWT->CYCCNT;
+#elif defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)__rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// min/avg/max of a cycle count over a reporting window
+struct DspStat {
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+
+    void Reset() {
+        min = UINT32_MAX;
+        max = 0;
+        sum = 0;
+    }
+
+    void Add(uint32_t cycles) {
+        if (cycles < min) min = cycles;
+        if (cycles > max) max = cycles;
+        sum += cycles;
+    }
+};
+
+// One reporting window, as handed to the main loop
+struct DspReport {
+    DspStat stages[DSP_STAGES];
+    DspStat block;          // Whole callback
+    uint32_t blocks;        // Callbacks in the window
+    uint32_t budget;        // Cycles per block at the sample rate
+    uint32_t overruns;      // Callbacks over budget, since Init()
+
+    uint32_t Average(const DspStat& stat) const {
+        return blocks ? (uint32_t)(stat.sum / blocks) : 0;
+    }
+};
+
+class DspProfiler {
+public:
+    DspProfiler() : last_(0), blockStart_(0), overruns_(0), reportRequested_(false), reportReady_(false) {
+        window_.budget = 0;
+        ResetWindow();
+    }
+
+    // Start the cycle counter. budget is the time one callback may take:
+    // cpuHz * blockSize / sampleRate.
+    void Init(uint32_t cpuHz, size_t blockSize, float sampleRate) {
+#if defined(__arm__)
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+        window_.budget = (uint32_t)((float)cpuHz * blockSize / sampleRate);
+        overruns_ = 0;
+        ResetWindow();
+    }
+
+    // Audio side: bracket each callback
+    void BlockStart() {
+        blockStart_ = DspCycles();
+        last_ = blockStart_;
+        for (size_t i = 0; i < DSP_STAGES; i++) {
+            blockStages_[i] = 0;
+        }
+    }
+
+    void Lap(DspStage stage) {
+        uint32_t now = DspCycles();
+        blockStages_[stage] += now - last_;
+        last_ = now;
+    }
+
+    void BlockEnd() {
+        uint32_t cycles = DspCycles() - blockStart_;
+        for (size_t i = 0; i < DSP_STAGES; i++) {
+            window_.stages[i].Add(blockStages_[i]);
+        }
+        window_.block.Add(cycles);
+        window_.blocks++;
+        if (window_.budget && cycles > window_.budget) {
+            overruns_++;
+        }
+
+        // Hand the window over when the main loop has asked for it
+        if (reportRequested_.load(std::memory_order_acquire)) {
+            window_.overruns = overruns_;
+            report_ = window_;
+            ResetWindow();
+            reportRequested_.store(false, std::memory_order_relaxed);
+            reportReady_.store(true, std::memory_order_release);
+        }
+    }
+
+    // Main loop side: ask for the current window, then poll until the next
+    // callback has delivered it. Returns true with the report filled in.
+    bool TakeReport(DspReport& report) {
+        if (reportReady_.load(std::memory_order_acquire)) {
+            report = report_;
+            reportReady_.store(false, std::memory_order_relaxed);
+            return true;
+        }
+        reportRequested_.store(true, std::memory_order_release);
+        return false;
+    }
+
+private:
+    uint32_t last_;
+    uint32_t blockStart_;
+    uint32_t blockStages_[DSP_STAGES];
+    uint32_t overruns_;
+    DspReport window_;
+    DspReport report_;
+    std::atomic<bool> reportRequested_;
+    std::atomic<bool> reportReady_;
+
+    void ResetWindow() {
+        for (size_t i = 0; i < DSP_STAGES; i++) {
+            window_.stages[i].Reset();
+        }
+        window_.block.Reset();
+        window_.blocks = 0;
+    }
+};
+
+DspProfiler g_dspProfiler;
+
+inline void DspLap(DspStage stage) {
+    g_dspProfiler.Lap(stage);
+}
+
+#else
+
+inline void DspLap(DspStage) {}
+
+#endif
@@ -0,0 +1,72 @@
+// Echo Bridge — High-quality convolution reverb for Daisy Seed
+// Copyright (C) 2025  Daniel Ramirez / LUFS Audio
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// .ebir: an IR with its partition spectra already computed, so loading it
+// is a straight copy into the spectra storage instead of a WAV decode plus
+// a full set of FFTs. All values are little-endian.
+//
+//   EbirHeader
+//   time-domain IR: length floats per path
+//   spectra: for each section, smallest partitions first, and each path,
+//            the partitions covering the IR from the section's default
+//            offset, SPECTRUM_SIZE floats each
+//
+// Paths are stored in IR_PATH_* order (LL, RR, LR, RL) and the header's
+// path count follows the layout (1, 2 or 4). layoutHash identifies the
+// partition layout and spectrum packing of the writer; a file written for
+// another layout still loads, but its spectra are ignored and recomputed.
+
+static const char EBIR_MAGIC[4] = {'E', 'B', 'I', 'R'};
+static const uint32_t EBIR_VERSION = 1;
+
+struct EbirHeader {
+    char magic[4];          // "EBIR"
+    uint32_t version;       // EBIR_VERSION
+    uint32_t layoutHash;    // Partition layout and spectrum format
+    uint32_t sampleRate;    // Engine sample rate the spectra were made for
+    uint32_t sourceHash;    // Size and date of the source WAV file(s)
+    uint32_t layout;        // IrLayout
+    uint32_t paths;         // Number of IR paths stored
+    uint32_t length;        // IR length in samples
+};
+
+// Stream callbacks; each call moves exactly bytes bytes or fails
+typedef bool (*EbirReadFn)(void* context, void* data, size_t bytes);
+typedef bool (*EbirWriteFn)(void* context, const void* data, size_t bytes);
+
+// Progress of an import or export that streams a slice per call
+enum EbirStatus {
+    EBIR_BUSY,      // More to do; call again
+    EBIR_DONE,
+    EBIR_FAILED
+};
+
+// FNV-1a, fed one 32-bit value at a time
+static const uint32_t EBIR_HASH_SEED = 2166136261u;
+
+inline uint32_t EbirHash(uint32_t hash, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        hash ^= (value >> (8 * i)) & 0xFF;
+        hash *= 16777619u;
+    }
+    return hash;
+}
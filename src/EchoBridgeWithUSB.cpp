@@ -18,7 +18,8 @@
 #include "daisysp.h"
 #include "hothouse.h"
 #include "IRLoader.h"
-#include "shy_fft.h"  // Include the ShyFFT library
+#include "IrFlashCache.h"
+#include "PartitionedConvolutionReverb.h"
 #include <string.h>
 
 using clevelandmusicco::Hothouse;
@@ -33,6 +34,9 @@ Hothouse hw;
 // USB/IR loading
 IRLoader irLoader;
 
+// Last-used IR in QSPI flash, restored at boot
+IrFlashCache irCache;
+
 // LEDs - Hothouse pedal only has two LEDs
 Led led1;  // LED 1 - Used for freeze status and temporarily for IR loading
 Led led2;  // LED 2 - Used for bypass status
@@ -43,608 +47,108 @@ bool freeze = false;
 bool usbMounted = false;
 bool irLoaded = false;
 bool isStereoInput = false; // Flag for stereo detection
-
-// Define FFT sizes
-static const size_t EARLY_FFT_SIZE = 64;     // Small FFT for early reflections (low latency)
-static const size_t LATE_FFT_SIZE = 1024;    // Larger FFT for late reflections (efficiency)
-static const size_t MAX_PREDELAY_SAMPLES = 24000; // 500ms at 48kHz
-
-// Global SDRAM buffers for late partition
-DSY_SDRAM_BSS float g_lateInputBuffer[LATE_FFT_SIZE];
-DSY_SDRAM_BSS float g_lateInputBufferRight[LATE_FFT_SIZE];
-DSY_SDRAM_BSS float g_lateOutputBuffer[LATE_FFT_SIZE * 2];
-DSY_SDRAM_BSS float g_lateOutputBufferRight[LATE_FFT_SIZE * 2];
-DSY_SDRAM_BSS float g_lateTimeIn[LATE_FFT_SIZE];
-DSY_SDRAM_BSS float g_lateTimeOut[LATE_FFT_SIZE];
-DSY_SDRAM_BSS float g_lateFreqReal[LATE_FFT_SIZE];
-DSY_SDRAM_BSS float g_lateFreqImag[LATE_FFT_SIZE];
-DSY_SDRAM_BSS float g_lateIrFreqReal[LATE_FFT_SIZE];
-DSY_SDRAM_BSS float g_lateIrFreqImag[LATE_FFT_SIZE];
-DSY_SDRAM_BSS float g_lateIrFreqRealRight[LATE_FFT_SIZE];
-DSY_SDRAM_BSS float g_lateIrFreqImagRight[LATE_FFT_SIZE];
-
-// Global SDRAM buffers for predelay
-DSY_SDRAM_BSS float g_predelayBuffer[MAX_PREDELAY_SAMPLES];
-DSY_SDRAM_BSS float g_predelayBufferRight[MAX_PREDELAY_SAMPLES];
-
-// Partitioned Convolution implementation
-class PartitionedConvolutionReverb {
-private:
-    // IR parameters
-    float* irBuffer;        // Left/mono IR
-    float* irBufferRight;   // Right IR for true stereo
-    size_t irLength;
-    
-    // FFT objects for early and late partitions
-    ShyFFT<float, EARLY_FFT_SIZE> earlyFft;
-    ShyFFT<float, LATE_FFT_SIZE> lateFft;
-    
-    // Early partition buffers - small enough to keep in internal memory
-    float earlyTimeIn[EARLY_FFT_SIZE];
-    float earlyTimeOut[EARLY_FFT_SIZE];
-    float earlyFreqReal[EARLY_FFT_SIZE];
-    float earlyFreqImag[EARLY_FFT_SIZE];
-    float earlyFreqRealRight[EARLY_FFT_SIZE];
-    float earlyFreqImagRight[EARLY_FFT_SIZE];
-    
-    // IR frequency domain for early partition
-    float earlyIrFreqReal[EARLY_FFT_SIZE];
-    float earlyIrFreqImag[EARLY_FFT_SIZE];
-    float earlyIrFreqRealRight[EARLY_FFT_SIZE];
-    float earlyIrFreqImagRight[EARLY_FFT_SIZE];
-    
-    // Input/output buffers for early partition
-    float earlyInputBuffer[EARLY_FFT_SIZE];
-    float earlyInputBufferRight[EARLY_FFT_SIZE];
-    float earlyOutputBuffer[EARLY_FFT_SIZE * 2];
-    float earlyOutputBufferRight[EARLY_FFT_SIZE * 2];
-    size_t earlyInputBufferPos;
-    
-    // Late partition buffers - using global SDRAM buffers
-    size_t lateInputBufferPos;
-    
-    // Predelay buffer - using global SDRAM buffers
-    size_t predelayBufferPos;
-    size_t predelayInSamples;
-    
-    // Parameters
-    float dryWet;           // Dry/wet mix (0.0 - 1.0)
-    float predelayMs;       // Predelay in milliseconds
-    float irLengthFactor;   // IR length factor (0.0 - 1.0)
-    float lowCutFreq;       // Low cut frequency
-    float highCutFreq;      // High cut frequency
-    float stereoWidth;      // Stereo width (0.0 - 2.0)
-    float sampleRate;       // Sample rate
-    bool trueStereoIR;      // True if using separate L/R IRs
-    
-    // Filters
-    daisysp::Svf lowCutFilterL;
-    daisysp::Svf highCutFilterL;
-    daisysp::Svf lowCutFilterR;
-    daisysp::Svf highCutFilterR;
-    
-    // Helper function to update IR in frequency domain
-    bool UpdateIRFrequencyDomain() {
-        // Clear the frequency domain buffers
-        memset(earlyIrFreqReal, 0, EARLY_FFT_SIZE * sizeof(float));
-        memset(earlyIrFreqImag, 0, EARLY_FFT_SIZE * sizeof(float));
-        memset(earlyIrFreqRealRight, 0, EARLY_FFT_SIZE * sizeof(float));
-        memset(earlyIrFreqImagRight, 0, EARLY_FFT_SIZE * sizeof(float));
-        
-        memset(g_lateIrFreqReal, 0, LATE_FFT_SIZE * sizeof(float));
-        memset(g_lateIrFreqImag, 0, LATE_FFT_SIZE * sizeof(float));
-        memset(g_lateIrFreqRealRight, 0, LATE_FFT_SIZE * sizeof(float));
-        memset(g_lateIrFreqImagRight, 0, LATE_FFT_SIZE * sizeof(float));
-        
-        // Apply IR length factor
-        size_t effectiveIrLength = (size_t)(irLength * irLengthFactor);
-        if (effectiveIrLength > irLength) effectiveIrLength = irLength;
-        
-        // Prepare early partition (first EARLY_FFT_SIZE samples of IR)
-        float earlyIrPadded[EARLY_FFT_SIZE];
-        float earlyIrPaddedRight[EARLY_FFT_SIZE];
-        
-        memset(earlyIrPadded, 0, EARLY_FFT_SIZE * sizeof(float));
-        memset(earlyIrPaddedRight, 0, EARLY_FFT_SIZE * sizeof(float));
-        
-        // Copy early part of IR (up to EARLY_FFT_SIZE samples)
-        size_t earlyLength = (effectiveIrLength < EARLY_FFT_SIZE) ? effectiveIrLength : EARLY_FFT_SIZE;
-        memcpy(earlyIrPadded, irBuffer, earlyLength * sizeof(float));
-        
-        if (trueStereoIR) {
-            memcpy(earlyIrPaddedRight, irBufferRight, earlyLength * sizeof(float));
-        } else {
-            memcpy(earlyIrPaddedRight, irBuffer, earlyLength * sizeof(float));
-        }
-        
-        // Transform early IR to frequency domain
-        earlyFft.Direct(earlyIrPadded, earlyTimeOut);
-        for (size_t i = 0; i < EARLY_FFT_SIZE; i++) {
-            earlyIrFreqReal[i] = earlyTimeOut[i];
-            earlyIrFreqImag[i] = 0.0f;
-        }
-        
-        earlyFft.Direct(earlyIrPaddedRight, earlyTimeOut);
-        for (size_t i = 0; i < EARLY_FFT_SIZE; i++) {
-            earlyIrFreqRealRight[i] = earlyTimeOut[i];
-            earlyIrFreqImagRight[i] = 0.0f;
-        }
-        
-        // Prepare late partition (remaining IR samples)
-        if (effectiveIrLength > EARLY_FFT_SIZE) {
-            float lateIrPadded[LATE_FFT_SIZE];
-            float lateIrPaddedRight[LATE_FFT_SIZE];
-            
-            memset(lateIrPadded, 0, LATE_FFT_SIZE * sizeof(float));
-            memset(lateIrPaddedRight, 0, LATE_FFT_SIZE * sizeof(float));
-            
-            // Copy late part of IR (from EARLY_FFT_SIZE to end)
-            size_t lateLength = effectiveIrLength - EARLY_FFT_SIZE;
-            if (lateLength > LATE_FFT_SIZE) lateLength = LATE_FFT_SIZE;
-            
-            memcpy(lateIrPadded, irBuffer + EARLY_FFT_SIZE, lateLength * sizeof(float));
-            
-            if (trueStereoIR) {
-                memcpy(lateIrPaddedRight, irBufferRight + EARLY_FFT_SIZE, lateLength * sizeof(float));
-            } else {
-                memcpy(lateIrPaddedRight, irBuffer + EARLY_FFT_SIZE, lateLength * sizeof(float));
-            }
-            
-            // Transform late IR to frequency domain
-            lateFft.Direct(lateIrPadded, g_lateTimeOut);
-            for (size_t i = 0; i < LATE_FFT_SIZE; i++) {
-                g_lateIrFreqReal[i] = g_lateTimeOut[i];
-                g_lateIrFreqImag[i] = 0.0f;
-            }
-            
-            lateFft.Direct(lateIrPaddedRight, g_lateTimeOut);
-            for (size_t i = 0; i < LATE_FFT_SIZE; i++) {
-                g_lateIrFreqRealRight[i] = g_lateTimeOut[i];
-                g_lateIrFreqImagRight[i] = 0.0f;
-            }
-        }
-        
-        return true;
-    }
-    
-public:
-    PartitionedConvolutionReverb() : 
-        irBuffer(nullptr),
-        irBufferRight(nullptr),
-        irLength(0),
-        earlyInputBufferPos(0),
-        lateInputBufferPos(0),
-        predelayBufferPos(0),
-        predelayInSamples(0),
-        dryWet(0.5f),
-        predelayMs(0.0f),
-        irLengthFactor(1.0f),
-        lowCutFreq(100.0f),
-        highCutFreq(10000.0f),
-        stereoWidth(1.0f),
-        sampleRate(48000.0f),
-        trueStereoIR(false)
-    {
-        // Initialize FFTs
-        earlyFft.Init();
-        lateFft.Init();
-    }
-    
-    ~PartitionedConvolutionReverb() {
-        // Free IR buffers
-        if (irBuffer) {
-            delete[] irBuffer;
-            irBuffer = nullptr;
-        }
-        
-        if (irBufferRight) {
-            delete[] irBufferRight;
-            irBufferRight = nullptr;
-        }
-    }
-    
-    // Initialize with sample rate
-    void Init(float sample_rate) {
-        sampleRate = sample_rate;
-        
-        // Initialize FFTs
-        earlyFft.Init();
-        lateFft.Init();
-        
-        // Clear buffers - must be done after hardware initialization for SDRAM buffers
-        memset(earlyInputBuffer, 0, sizeof(earlyInputBuffer));
-        memset(earlyInputBufferRight, 0, sizeof(earlyInputBufferRight));
-        memset(earlyOutputBuffer, 0, sizeof(earlyOutputBuffer));
-        memset(earlyOutputBufferRight, 0, sizeof(earlyOutputBufferRight));
-        
-        memset(g_lateInputBuffer, 0, sizeof(g_lateInputBuffer));
-        memset(g_lateInputBufferRight, 0, sizeof(g_lateInputBufferRight));
-        memset(g_lateOutputBuffer, 0, sizeof(g_lateOutputBuffer));
-        memset(g_lateOutputBufferRight, 0, sizeof(g_lateOutputBufferRight));
-        
-        memset(g_predelayBuffer, 0, sizeof(g_predelayBuffer));
-        memset(g_predelayBufferRight, 0, sizeof(g_predelayBufferRight));
-        
-        // Initialize filters with sample rate
-        lowCutFilterL.Init(sampleRate);
-        highCutFilterL.Init(sampleRate);
-        lowCutFilterR.Init(sampleRate);
-        highCutFilterR.Init(sampleRate);
-        
-        // Update filter parameters
-        UpdateFilters();
-    }
-    
-    // Load IR from buffer - now using external SDRAM for IR storage
-    bool LoadIR(float* buffer, size_t length) {
-        // Check if length is valid
-        if (length == 0 || length > MAX_IR_LENGTH) {
-            return false;
-        }
-        
-        // Free old buffer if it exists
-        if (irBuffer) {
-            delete[] irBuffer;
-        }
-        
-        // Allocate new buffer in SDRAM
-        irBuffer = new float[length];
-        if (!irBuffer) {
-            return false;
-        }
-        
-        // Copy data
-        memcpy(irBuffer, buffer, length * sizeof(float));
-        irLength = length;
-        
-        // Not true stereo
-        trueStereoIR = false;
-        
-        // Update frequency domain representation
-        return UpdateIRFrequencyDomain();
-    }
-    
-    // Load stereo IR from buffers - now using external SDRAM for IR storage
-    bool LoadStereoIR(float* bufferL, float* bufferR, size_t length) {
-        // Check if length is valid
-        if (length == 0 || length > MAX_IR_LENGTH) {
-            return false;
-        }
-        
-        // Free old buffers if they exist
-        if (irBuffer) {
-            delete[] irBuffer;
-        }
-        
-        if (irBufferRight) {
-            delete[] irBufferRight;
-        }
-        
-        // Allocate new buffers in SDRAM
-        irBuffer = new float[length];
-        irBufferRight = new float[length];
-        
-        if (!irBuffer || !irBufferRight) {
-            if (irBuffer) {
-                delete[] irBuffer;
-                irBuffer = nullptr;
-            }
-            
-            if (irBufferRight) {
-                delete[] irBufferRight;
-                irBufferRight = nullptr;
-            }
-            
-            return false;
-        }
-        
-        // Copy data
-        memcpy(irBuffer, bufferL, length * sizeof(float));
-        memcpy(irBufferRight, bufferR, length * sizeof(float));
-        irLength = length;
-        
-        // True stereo
-        trueStereoIR = true;
-        
-        // Update frequency domain representation
-        return UpdateIRFrequencyDomain();
-    }
-    
-    // Set dry/wet mix
-    void SetDryWet(float value) {
-        dryWet = value;
-    }
-    
-    // Set predelay in milliseconds
-    void SetPredelay(float ms) {
-        predelayMs = ms;
-        predelayInSamples = (size_t)(predelayMs * sampleRate / 1000.0f);
-        if (predelayInSamples >= MAX_PREDELAY_SAMPLES) {
-            predelayInSamples = MAX_PREDELAY_SAMPLES - 1;
-        }
-    }
-    
-    // Set IR length factor
-    void SetIRLengthFactor(float factor) {
-        if (factor != irLengthFactor) {
-            irLengthFactor = factor;
-            UpdateIRFrequencyDomain();
-        }
-    }
-    
-    // Set low cut frequency
-    void SetLowCut(float freq) {
-        lowCutFreq = freq;
-        UpdateFilters();
-    }
-    
-    // Set high cut frequency
-    void SetHighCut(float freq) {
-        highCutFreq = freq;
-        UpdateFilters();
-    }
-    
-    // Set stereo width
-    void SetStereoWidth(float width) {
-        stereoWidth = width;
-    }
-    
-    // Update filter parameters
-    void UpdateFilters() {
-        // Low cut filter (high pass)
-        lowCutFilterL.SetFreq(lowCutFreq);
-        lowCutFilterL.SetRes(0.707f);
-        lowCutFilterL.SetDrive(1.0f);
-        
-        highCutFilterL.SetFreq(highCutFreq);
-        highCutFilterL.SetRes(0.707f);
-        highCutFilterL.SetDrive(1.0f);
-        
-        lowCutFilterR.SetFreq(lowCutFreq);
-        lowCutFilterR.SetRes(0.707f);
-        lowCutFilterR.SetDrive(1.0f);
-        
-        highCutFilterR.SetFreq(highCutFreq);
-        highCutFilterR.SetRes(0.707f);
-        highCutFilterR.SetDrive(1.0f);
-    }
-    
-    // Process a single sample
-    void Process(float inL, float inR, float* outL, float* outR) {
-        // If no IR is loaded, pass through
-        if (!irBuffer) {
-            *outL = inL;
-            *outR = inR;
-            return;
-        }
-        
-        // Store input in predelay buffer
-        g_predelayBuffer[predelayBufferPos] = inL;
-        g_predelayBufferRight[predelayBufferPos] = inR;
-        
-        // Get delayed input
-        size_t delayedPos = (predelayBufferPos + MAX_PREDELAY_SAMPLES - predelayInSamples) % MAX_PREDELAY_SAMPLES;
-        float delayedL = g_predelayBuffer[delayedPos];
-        float delayedR = g_predelayBufferRight[delayedPos];
-        
-        // Advance predelay buffer position
-        predelayBufferPos = (predelayBufferPos + 1) % MAX_PREDELAY_SAMPLES;
-        
-        // Store input in early and late buffers
-        earlyInputBuffer[earlyInputBufferPos] = delayedL;
-        earlyInputBufferRight[earlyInputBufferPos] = delayedR;
-        
-        g_lateInputBuffer[lateInputBufferPos] = delayedL;
-        g_lateInputBufferRight[lateInputBufferPos] = delayedR;
-        
-        // Process early partition (low latency)
-        earlyInputBufferPos++;
-        if (earlyInputBufferPos >= EARLY_FFT_SIZE) {
-            // Reset input buffer position
-            earlyInputBufferPos = 0;
-            
-            // Process left channel
-            memcpy(earlyTimeIn, earlyInputBuffer, EARLY_FFT_SIZE * sizeof(float));
-            earlyFft.Direct(earlyTimeIn, earlyTimeOut);
-            
-            for (size_t i = 0; i < EARLY_FFT_SIZE; i++) {
-                earlyFreqReal[i] = earlyTimeOut[i];
-                earlyFreqImag[i] = 0.0f;
-            }
-            
-            // Complex multiplication with IR
-            for (size_t i = 0; i < EARLY_FFT_SIZE; i++) {
-                float a = earlyFreqReal[i];
-                float b = earlyFreqImag[i];
-                float c = earlyIrFreqReal[i];
-                float d = earlyIrFreqImag[i];
-                
-                earlyFreqReal[i] = a*c - b*d;
-                earlyFreqImag[i] = a*d + b*c;
-            }
-            
-            // Transform back to time domain
-            earlyFft.Inverse(earlyFreqReal, earlyFreqImag, EARLY_FFT_SIZE);
-            
-            // Process right channel
-            memcpy(earlyTimeIn, earlyInputBufferRight, EARLY_FFT_SIZE * sizeof(float));
-            earlyFft.Direct(earlyTimeIn, earlyTimeOut);
-            
-            for (size_t i = 0; i < EARLY_FFT_SIZE; i++) {
-                earlyFreqReal[i] = earlyTimeOut[i];
-                earlyFreqImag[i] = 0.0f;
-            }
-            
-            // Complex multiplication with IR
-            for (size_t i = 0; i < EARLY_FFT_SIZE; i++) {
-                float a = earlyFreqReal[i];
-                float b = earlyFreqImag[i];
-                float c = earlyIrFreqRealRight[i];
-                float d = earlyIrFreqImagRight[i];
-                
-                earlyFreqReal[i] = a*c - b*d;
-                earlyFreqImag[i] = a*d + b*c;
-            }
-            
-            // Transform back to time domain
-            earlyFft.Inverse(earlyFreqReal, earlyFreqImag, EARLY_FFT_SIZE);
-            
-            // Overlap-add
-            for (size_t i = 0; i < EARLY_FFT_SIZE; i++) {
-                earlyOutputBuffer[i] = earlyOutputBuffer[i + EARLY_FFT_SIZE] + earlyFreqReal[i];
-                earlyOutputBufferRight[i] = earlyOutputBufferRight[i + EARLY_FFT_SIZE] + earlyFreqReal[i];
-            }
-            
-            // Clear the second half of the output buffer
-            memset(earlyOutputBuffer + EARLY_FFT_SIZE, 0, EARLY_FFT_SIZE * sizeof(float));
-            memset(earlyOutputBufferRight + EARLY_FFT_SIZE, 0, EARLY_FFT_SIZE * sizeof(float));
-        }
-        
-        // Process late partition (efficiency)
-        lateInputBufferPos++;
-        if (lateInputBufferPos >= LATE_FFT_SIZE) {
-            // Reset input buffer position
-            lateInputBufferPos = 0;
-            
-            // Process left channel
-            memcpy(g_lateTimeIn, g_lateInputBuffer, LATE_FFT_SIZE * sizeof(float));
-            lateFft.Direct(g_lateTimeIn, g_lateTimeOut);
-            
-            for (size_t i = 0; i < LATE_FFT_SIZE; i++) {
-                g_lateFreqReal[i] = g_lateTimeOut[i];
-                g_lateFreqImag[i] = 0.0f;
-            }
-            
-            // Complex multiplication with IR
-            for (size_t i = 0; i < LATE_FFT_SIZE; i++) {
-                float a = g_lateFreqReal[i];
-                float b = g_lateFreqImag[i];
-                float c = g_lateIrFreqReal[i];
-                float d = g_lateIrFreqImag[i];
-                
-                g_lateFreqReal[i] = a*c - b*d;
-                g_lateFreqImag[i] = a*d + b*c;
-            }
-            
-            // Transform back to time domain
-            lateFft.Inverse(g_lateFreqReal, g_lateFreqImag, LATE_FFT_SIZE);
-            
-            // Process right channel
-            memcpy(g_lateTimeIn, g_lateInputBufferRight, LATE_FFT_SIZE * sizeof(float));
-            lateFft.Direct(g_lateTimeIn, g_lateTimeOut);
-            
-            for (size_t i = 0; i < LATE_FFT_SIZE; i++) {
-                g_lateFreqReal[i] = g_lateTimeOut[i];
-                g_lateFreqImag[i] = 0.0f;
-            }
-            
-            // Complex multiplication with IR
-            for (size_t i = 0; i < LATE_FFT_SIZE; i++) {
-                float a = g_lateFreqReal[i];
-                float b = g_lateFreqImag[i];
-                float c = g_lateIrFreqRealRight[i];
-                float d = g_lateIrFreqImagRight[i];
-                
-                g_lateFreqReal[i] = a*c - b*d;
-                g_lateFreqImag[i] = a*d + b*c;
-            }
-            
-            // Transform back to time domain
-            lateFft.Inverse(g_lateFreqReal, g_lateFreqImag, LATE_FFT_SIZE);
-            
-            // Overlap-add
-            for (size_t i = 0; i < LATE_FFT_SIZE; i++) {
-                g_lateOutputBuffer[i] = g_lateOutputBuffer[i + LATE_FFT_SIZE] + g_lateFreqReal[i];
-                g_lateOutputBufferRight[i] = g_lateOutputBufferRight[i + LATE_FFT_SIZE] + g_lateFreqReal[i];
-            }
-            
-            // Clear the second half of the output buffer
-            memset(g_lateOutputBuffer + LATE_FFT_SIZE, 0, LATE_FFT_SIZE * sizeof(float));
-            memset(g_lateOutputBufferRight + LATE_FFT_SIZE, 0, LATE_FFT_SIZE * sizeof(float));
-        }
-        
-        // Get output from early and late partitions
-        float wetL = earlyOutputBuffer[0] + g_lateOutputBuffer[0];
-        float wetR = earlyOutputBufferRight[0] + g_lateOutputBufferRight[0];
-        
-        // Apply filters
-        lowCutFilterL.Process(wetL);
-        float filteredL = lowCutFilterL.High();
-        highCutFilterL.Process(filteredL);
-        filteredL = highCutFilterL.Low();
-        
-        lowCutFilterR.Process(wetR);
-        float filteredR = lowCutFilterR.High();
-        highCutFilterR.Process(filteredR);
-        filteredR = highCutFilterR.Low();
-        
-        // Apply stereo width
-        if (stereoWidth != 1.0f) {
-            float mid = (filteredL + filteredR) * 0.5f;
-            float side = (filteredL - filteredR) * 0.5f * stereoWidth;
-            filteredL = mid + side;
-            filteredR = mid - side;
-        }
-        
-        // Mix dry and wet signals
-        *outL = inL * (1.0f - dryWet) + filteredL * dryWet;
-        *outR = inR * (1.0f - dryWet) + filteredR * dryWet;
-        
-        // Shift output buffers
-        for (size_t i = 0; i < EARLY_FFT_SIZE - 1; i++) {
-            earlyOutputBuffer[i] = earlyOutputBuffer[i + 1];
-            earlyOutputBufferRight[i] = earlyOutputBufferRight[i + 1];
-        }
-        
-        for (size_t i = 0; i < LATE_FFT_SIZE - 1; i++) {
-            g_lateOutputBuffer[i] = g_lateOutputBuffer[i + 1];
-            g_lateOutputBufferRight[i] = g_lateOutputBufferRight[i + 1];
-        }
-    }
-};
+size_t monoSamples = 0;     // Samples the stereo input has matched L == R
+float irSelectKnob = 0.0f;  // Knob 6 position, mapped onto the loaded IR slots
 
 // Create the reverb processor
 PartitionedConvolutionReverb reverb;
 
+// Decimation of the IR tail past 170ms: 2 or 4 runs it at half or a
+// quarter of the sample rate for less CPU and slot memory, band-limited to
+// a quarter or an eighth of the sample rate; 1 keeps the whole IR at the
+// full rate. Set by the build profile (see BuildProfile.h).
+static const size_t TAIL_DECIMATION = PROFILE_TAIL_DECIMATION;
+
+// Stereo detection with hysteresis, once per block: a channel difference
+// above STEREO_ON_LEVEL (peak) turns stereo processing on, and it goes back
+// to mono once the channels have stayed within STEREO_OFF_LEVEL for
+// STEREO_HOLD_SAMPLES
+static const float STEREO_ON_LEVEL = 0.01f;     // -40dB
+static const float STEREO_OFF_LEVEL = 0.001f;   // -60dB
+static const size_t STEREO_HOLD_SAMPLES = PROFILE_SAMPLE_RATE; // 1s
+
+#ifdef ECHO_PROFILER
+// Profiler builds log the per-stage cycle counts and the CPU load over the
+// USB serial port once per PROFILER_REPORT_MS
+daisy::CpuLoadMeter loadMeter;
+static const uint32_t PROFILER_REPORT_MS = 1000;
+uint32_t profilerReportAt = 0;
+#endif
+
 // Audio callback
 void AudioCallback(AudioHandle::InputBuffer in, AudioHandle::OutputBuffer out, size_t size) {
-    // Process each sample
+#ifdef ECHO_PROFILER
+    loadMeter.OnBlockStart();
+    g_dspProfiler.BlockStart();
+#endif
+
+    // Detect stereo input
+    float difference = 0.0f;
     for (size_t i = 0; i < size; i++) {
-        // Get input samples
-        float inL = in[0][i];
-        float inR = in[1][i];
-        
-        // Detect stereo input
-        if (!isStereoInput && fabs(inL - inR) > 0.01f) {
-            isStereoInput = true;
-            // No LED indicator for stereo mode in Hothouse pedal (only 2 LEDs available)
-        }
-        
-        // Process
-        float outL, outR;
-        
-        if (bypass) {
-            // Bypass mode
-            outL = inL;
-            outR = inR;
-        } else if (freeze) {
-            // Freeze mode - only output reverb tail
-            reverb.Process(0.0f, 0.0f, &outL, &outR);
-        } else {
-            // Normal mode
-            reverb.Process(inL, inR, &outL, &outR);
+        difference = fmaxf(difference, fabsf(in[0][i] - in[1][i]));
+    }
+    if (difference > STEREO_ON_LEVEL) {
+        // No LED indicator for stereo mode in Hothouse pedal (only 2 LEDs available)
+        isStereoInput = true;
+        monoSamples = 0;
+    } else if (isStereoInput && difference < STEREO_OFF_LEVEL) {
+        monoSamples += size;
+        if (monoSamples >= STEREO_HOLD_SAMPLES) {
+            isStereoInput = false;
         }
-        
-        // Output
-        out[0][i] = outL;
-        out[1][i] = outR;
+    } else {
+        monoSamples = 0;
     }
+
+    // Mono input lets the reverb share one convolution between both channels
+    reverb.SetStereoInput(isStereoInput);
+
+    // Bypassed, the reverb passes the dry signal and lets its tail ring
+    // out; frozen, it holds its sustain under the dry signal. Once input
+    // and tail are silent it gates its convolution off.
+    reverb.ProcessBlock(in, out, size);
+
+#ifdef ECHO_PROFILER
+    g_dspProfiler.BlockEnd();
+    loadMeter.OnBlockEnd();
+#endif
 }
 
+#ifdef ECHO_PROFILER
+// Log the last report window: per stage and for the whole callback the
+// min/avg/max cycles per callback, then the deadline overruns and the load
+void ReportProfiler() {
+    if (System::GetNow() - profilerReportAt < PROFILER_REPORT_MS) {
+        return;
+    }
+
+    DspReport report;
+    if (!g_dspProfiler.TakeReport(report)) {
+        return;
+    }
+    profilerReportAt = System::GetNow();
+
+    for (size_t i = 0; i < DSP_STAGES; i++) {
+        const DspStat& stat = report.stages[i];
+        hw.seed.PrintLine("%-8s %6lu %6lu %6lu", DSP_STAGE_NAMES[i], (unsigned long)stat.min,
+                          (unsigned long)report.Average(stat), (unsigned long)stat.max);
+    }
+    hw.seed.PrintLine("block    %6lu %6lu %6lu of %lu, %lu blocks, %lu overruns",
+                      (unsigned long)report.block.min, (unsigned long)report.Average(report.block),
+                      (unsigned long)report.block.max, (unsigned long)report.budget,
+                      (unsigned long)report.blocks, (unsigned long)report.overruns);
+    hw.seed.PrintLine("load     avg %d.%d%% max %d.%d%%",
+                      (int)(loadMeter.GetAvgCpuLoad() * 100.0f), (int)(loadMeter.GetAvgCpuLoad() * 1000.0f) % 10,
+                      (int)(loadMeter.GetMaxCpuLoad() * 100.0f), (int)(loadMeter.GetMaxCpuLoad() * 1000.0f) % 10);
+    loadMeter.Reset();
+}
+#endif
+
 // Handle footswitch 1 (freeze) - SWAPPED from original implementation
 void HandleFootswitch1(bool pressed) {
     if (pressed) {
         freeze = !freeze;
+        reverb.SetFreeze(freeze);
         led1.Set(freeze ? 1.0f : 0.0f);
     }
 }
@@ -653,6 +157,7 @@ void HandleFootswitch1(bool pressed) {
 void HandleFootswitch2(bool pressed) {
     if (pressed) {
         bypass = !bypass;
+        reverb.SetBypass(bypass);
         led2.Set(bypass ? 0.0f : 1.0f);
     }
 }
@@ -668,36 +173,59 @@ void HandleFootswitch2LongPress() {
     reverb.SetStereoWidth(1.0f);
 }
 
-// Handle footswitch 1 long press (load IR from USB) - SWAPPED from original implementation
-void HandleFootswitch1LongPress() {
-    // Set LED1 to blink during IR loading (temporary indicator)
-    led1.Set(1.0f);
+// LED 1 feedback for IR loads, driven from the main loop so it never
+// blocks: steady on while a load runs, then quick blinks for success or
+// slow ones for failure before it returns to the freeze status
+int loadBlinksLeft = 0;
+uint32_t loadBlinkMs = 0;       // Half period
+uint32_t loadBlinkStart = 0;
+
+void ShowLoadResult(bool success) {
+    irLoaded = success;
+    loadBlinksLeft = success ? 5 : 3;
+    loadBlinkMs = success ? 50 : 200;
+    loadBlinkStart = System::GetNow();
+}
+
+// Select the IR slot under knob 6, spreading the loaded slots evenly
+// over its travel
+void SelectIRSlot() {
+    size_t count = reverb.IRSlotCount();
+    size_t slot = (size_t)(irSelectKnob * count);
+    reverb.SelectIRSlot((count > 0 && slot >= count) ? count - 1 : slot);
+}
+
+void UpdateLoadLed() {
+    IRLoader::LoadResult result = irLoader.TakeResult();
+    if (result != IRLoader::LOAD_NONE) {
+        ShowLoadResult(result == IRLoader::LOAD_OK);
+        SelectIRSlot();
+    }
     
-    // Try to load IR from USB
-    if (irLoader.LoadIR()) {
-        irLoaded = true;
-        
-        // Blink LED1 rapidly a few times to indicate success
-        for (int i = 0; i < 5; i++) {
-            led1.Set(0.0f);
-            System::Delay(50);
-            led1.Set(1.0f);
-            System::Delay(50);
-        }
-    } else {
-        irLoaded = false;
-        
-        // Blink LED1 slowly a few times to indicate failure
-        for (int i = 0; i < 3; i++) {
-            led1.Set(0.0f);
-            System::Delay(200);
-            led1.Set(1.0f);
-            System::Delay(200);
-        }
+    if (irLoader.Loading()) {
+        led1.Set(1.0f);
+        return;
     }
     
-    // Return LED1 to showing freeze status
-    led1.Set(freeze ? 1.0f : 0.0f);
+    if (loadBlinksLeft > 0) {
+        // Each blink is off then on
+        uint32_t phase = (System::GetNow() - loadBlinkStart) / loadBlinkMs;
+        if (phase < 2 * (uint32_t)loadBlinksLeft) {
+            led1.Set((phase & 1) ? 1.0f : 0.0f);
+        } else {
+            loadBlinksLeft = 0;
+            led1.Set(freeze ? 1.0f : 0.0f);
+        }
+    }
+}
+
+// Handle footswitch 1 long press (load IR from USB) - SWAPPED from original implementation
+void HandleFootswitch1LongPress() {
+    // The load runs in the main loop a slice at a time; LED 1 follows it
+    // in UpdateLoadLed()
+    if (!irLoader.StartLoad() && !irLoader.Loading()) {
+        ShowLoadResult(false);
+    }
 }
 
 // Handle knob 1 (dry/wet)
@@ -739,24 +267,99 @@ void HandleKnob5(float value) {
     reverb.SetStereoWidth(stereoWidth);
 }
 
-// Handle knob 6 (custom parameter)
+// Handle knob 6 (IR select)
 void HandleKnob6(float value) {
-    // Custom parameter - not used yet
+    irSelectKnob = value;
+    SelectIRSlot();
 }
 
-// Set up IR loader callback
-bool LoadIRCallback(float* bufferL, float* bufferR, size_t length) {
+// Set up IR slot callbacks
+bool ClearIRSlotsCallback() {
+    return reverb.ClearIRSlots();
+}
+
+bool LoadIRCallback(size_t slot, float* bufferL, float* bufferR, size_t length) {
     if (bufferR) {
-        return reverb.LoadStereoIR(bufferL, bufferR, length);
+        return reverb.LoadStereoIR(slot, bufferL, bufferR, length);
     } else {
-        return reverb.LoadIR(bufferL, length);
+        return reverb.LoadIR(slot, bufferL, length);
+    }
+}
+
+// Set up true-stereo IR loader callback
+bool LoadTrueStereoIRCallback(size_t slot, float* ll, float* lr, float* rl, float* rr, size_t length) {
+    return reverb.LoadTrueStereoIR(slot, ll, lr, rl, rr, length);
+}
+
+// Set up precomputed (.ebir) IR callbacks
+bool LoadPrecomputedIRCallback(size_t slot, const EbirHeader& header, float* const* paths) {
+    return reverb.LoadPrecomputedIR(slot, header, paths);
+}
+
+EbirStatus ImportPrecomputedIRCallback(EbirReadFn read, void* context) {
+    return reverb.ImportPrecomputedIR(read, context);
+}
+
+EbirStatus SavePrecomputedIRCallback(size_t slot, EbirWriteFn write, void* context, uint32_t sourceHash) {
+    return reverb.ExportIR(slot, write, context, sourceHash);
+}
+
+// Restore the cached IR into slot 0, transforming it here if the cache only
+// holds the time-domain IR. Runs before audio starts, so it can block.
+void RestoreIRCache() {
+    EbirHeader header;
+    const float* paths[4];
+    if (!irCache.Open(header, paths) || !reverb.LoadPrecomputedIR(0, header, paths)) {
+        return;
+    }
+    
+    while (reverb.ImportPrecomputedIR(IrFlashCache::Read, &irCache) == EBIR_BUSY) {}
+    while (!reverb.UpdateIR()) {}
+    irLoaded = true;
+}
+
+// Rewrite the cache once the IR that plays has been kept for a while, so
+// sweeping knob 6 does not wear the flash
+static const uint32_t IR_CACHE_SETTLE_MS = 5000;
+size_t cacheCandidate = NO_IR_SLOT;
+uint32_t cacheCandidateHash = 0;
+uint32_t cacheCandidateSince = 0;
+uint32_t cacheSaveHash = 0;     // Last IR a save was started for, tried once
+
+void UpdateIRCache() {
+    // A USB load empties the slots and exports its own .ebir files
+    if (irLoader.Loading()) {
+        if (!irCache.Idle()) {
+            irCache.Cancel();
+            cacheSaveHash = 0;
+        }
+        cacheCandidate = NO_IR_SLOT;
+        return;
+    }
+    
+    irCache.Process();
+    
+    size_t slot = reverb.PlayingIRSlot();
+    uint32_t hash = (slot != NO_IR_SLOT) ? irLoader.SlotSourceHash(slot) : 0;
+    if (slot != cacheCandidate || hash != cacheCandidateHash) {
+        cacheCandidate = slot;
+        cacheCandidateHash = hash;
+        cacheCandidateSince = System::GetNow();
+        return;
+    }
+    
+    if (hash != 0 && hash != irCache.CachedHash() && hash != cacheSaveHash && irCache.Idle() &&
+        System::GetNow() - cacheCandidateSince >= IR_CACHE_SETTLE_MS) {
+        cacheSaveHash = hash;
+        irCache.Save(slot, hash, reverb.ExportIRSize(slot, true), reverb.ExportIRSize(slot, false));
     }
 }
 
 // Main function
 int main(void) {
-    // Initialize hardware
-    hw.Init();
+    // Initialize hardware at the build profile's block size and sample rate
+    hw.Init(PROFILE_BLOCK_SIZE, (PROFILE_SAMPLE_RATE == 96000) ? SaiHandle::Config::SampleRate::SAI_96KHZ
+                                                                : SaiHandle::Config::SampleRate::SAI_48KHZ);
     
     // Initialize LEDs - Hothouse pedal only has two LEDs
     led1.Init(hw.seed.GetPin(hw.LED_1), false);  // LED 1 - Used for freeze status and temporarily for IR loading
@@ -768,11 +371,43 @@ int main(void) {
     
     // Initialize USB host for IR loading
     irLoader.Init();
+    IRLoader::ClearIRSlotsCallback = ClearIRSlotsCallback;
     IRLoader::LoadIRCallback = LoadIRCallback;
+    IRLoader::LoadTrueStereoIRCallback = LoadTrueStereoIRCallback;
+    IRLoader::LoadPrecomputedIRCallback = LoadPrecomputedIRCallback;
+    IRLoader::ImportPrecomputedIRCallback = ImportPrecomputedIRCallback;
+    IRLoader::SavePrecomputedIRCallback = SavePrecomputedIRCallback;
+    irCache.Init(&hw.seed.qspi);
+    IrFlashCache::SaveIRCallback = SavePrecomputedIRCallback;
     
     // Initialize reverb
     reverb.Init(hw.AudioSampleRate());
     
+#ifdef ECHO_PROFILER
+    // Profiler reports go to the USB serial port; audio starts without
+    // waiting for a terminal
+    hw.seed.StartLog(false);
+    g_dspProfiler.Init(System::GetSysClkFreq(), PROFILE_BLOCK_SIZE, hw.AudioSampleRate());
+    loadMeter.Init(hw.AudioSampleRate(), PROFILE_BLOCK_SIZE);
+#endif
+    
+    // Run the first IR taps as a time-domain FIR so the wet signal starts
+    // with the dry one (must be set before audio starts)
+    reverb.SetZeroLatency(true);
+    
+    // Bake the tone knob into the IR once it rests, so the wet filters
+    // only run while it moves
+    reverb.SetFilterFolding(true);
+    
+    // Multirate tail (drops the IR slots, so before any IR is loaded)
+    reverb.SetTailDecimation(TAIL_DECIMATION);
+    
+    // The pedal starts bypassed
+    reverb.SetBypass(bypass);
+    
+    // Play the last-used IR from flash until a USB drive brings others
+    RestoreIRCache();
+    
     // Set up audio callback
     hw.StartAudio(AudioCallback);
     
@@ -795,11 +430,30 @@ int main(void) {
         // Process hardware events
         hw.ProcessAllControls();
         
-        // Process USB events
+        // Process USB events and advance an IR load by one slice
         irLoader.Process();
         
+        // Prepare queued IR changes a slice at a time and hand them to the
+        // audio callback
+        bool irSettled = reverb.UpdateIR();
+        
+        // Keep the flash copy of the playing IR up to date
+        UpdateIRCache();
+        
+#ifdef ECHO_PROFILER
+        ReportProfiler();
+#endif
+        
         // Update LEDs - Hothouse pedal only has two LEDs
+        UpdateLoadLed();
         led1.Update();  // LED 1 for freeze status
         led2.Update();  // LED 2 for bypass status
+        
+        // With no slices left to run, sleep until the next interrupt (audio
+        // DMA, SysTick or USB) instead of spinning; this keeps the CPU off
+        // the bus the audio DMA and the SDRAM reads share
+        if (irSettled && !irLoader.Loading() && irCache.Idle()) {
+            __WFI();
+        }
     }
 }
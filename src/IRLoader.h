@@ -19,552 +19,854 @@
 
 #include "daisy_seed.h"
 #include "hid/usb_host.h"
+#include "EbirFile.h"
+#include "WavReader.h"
+#include <stdio.h>
 #include <string.h>
 
 using namespace daisy;
 
 // Define max IR length as a global constant so it can be accessed from IRLoader
-static const size_t MAX_IR_LENGTH = 4096;
+static const size_t MAX_IR_LENGTH = 4 * 48000; // 4 seconds at 48kHz
 
-// Class for loading impulse response files from USB
+// IR slots a load fills; knob 6 picks the one that plays
+static const size_t IR_SLOTS = 8;
+
+// Samples per buffer read, normalized or scanned per Process() call
+static const size_t IR_LOAD_SLICE = 4096;
+
+// Tail trimming of decoded WAV IRs: the IR ends where its energy decay
+// curve (the energy left from a sample on, relative to the whole IR) falls
+// below the threshold, so padding of noise floor or digital silence is not
+// convolved. The last IR_TRIM_FADE samples kept are faded out.
+static const float IR_TRIM_THRESHOLD_DB = -80.0f;
+static const size_t IR_TRIM_FADE = 480; // 10ms at 48kHz
+
+// Decode buffers for IR loading - in SDRAM so multi-second IRs fit
+DSY_SDRAM_BSS float g_irLoadBufferL[MAX_IR_LENGTH];
+DSY_SDRAM_BSS float g_irLoadBufferR[MAX_IR_LENGTH];
+DSY_SDRAM_BSS float g_irLoadBufferLR[MAX_IR_LENGTH];
+DSY_SDRAM_BSS float g_irLoadBufferRL[MAX_IR_LENGTH];
+
+// IR file sets in the drive's root, in the order a load tries them; the
+// first one found fills slot 0. Each IR is taken from its precomputed .ebir
+// file when that is up to date with the WAV file(s), or from the WAV, which
+// then gets an .ebir written next to it for the next load.
+enum IrFileSetIndex {
+    IR_SET_MONO,
+    IR_SET_TRUE_STEREO,
+    IR_SET_STEREO,
+    IR_SETS
+};
+
+struct IrFileSet {
+    const char* ebir;
+    const char* const* sources;  // WAV files the .ebir is made from
+    size_t sourceCount;
+};
+
+static const char* const IR_MONO_SOURCES[] = {"ir_mono.wav"};
+static const char* const IR_TRUE_STEREO_SOURCES[] = {"ir_true_stereo.wav", "ir_ll.wav", "ir_lr.wav", "ir_rl.wav", "ir_rr.wav"};
+static const char* const IR_STEREO_SOURCES[] = {"ir_left.wav", "ir_right.wav"};
+
+static const IrFileSet IR_FILE_SETS[IR_SETS] = {
+    {"ir_mono.ebir", IR_MONO_SOURCES, 1},
+    {"ir_true_stereo.ebir", IR_TRUE_STEREO_SOURCES, 5},
+    {"ir_stereo.ebir", IR_STEREO_SOURCES, 2}
+};
+
+// The remaining slots are filled from this directory in name order. Each
+// IR is a WAV file whose channel count sets its layout (1 mono, 2 stereo,
+// 4 true stereo, anything else mixed down to mono) and/or the .ebir file of
+// the same name.
+static const char IR_DIRECTORY[] = "irs";
+static const size_t IR_NAME_LENGTH = 64; // Longest base name, terminator included
+
+// Class for loading impulse response files from USB into the reverb's IR
+// slots. A load is a state machine advanced one slice (one read chunk, one
+// directory entry, one slice of samples or spectra) per Process() call, so
+// the main loop keeps handling controls while it runs and the audio keeps
+// the old IR until a new one is published.
 class IRLoader {
 public:
-    IRLoader() : usbh_(nullptr), mounted_(false) {}
+    enum LoadResult {
+        LOAD_NONE,      // No load finished since the last TakeResult()
+        LOAD_OK,
+        LOAD_FAILED
+    };
+
+    IRLoader() :
+        usbReady_(false),
+        mounted_(false),
+        usbActive_(false),
+        usbDisconnected_(false),
+        state_(LOAD_IDLE),
+        result_(LOAD_NONE),
+        set_(0),
+        slot_(0),
+        dirOpen_(false),
+        entryCount_(0),
+        ebirName_(nullptr),
+        sourceHash_(0),
+        fileOpen_(false),
+        bufferCount_(0),
+        stepCount_(0),
+        step_(0),
+        channel_(0),
+        stepFrames_(0),
+        frames_(0),
+        path_(0),
+        pos_(0),
+        peak_(0.0f),
+        energy_(0.0f),
+        tailEnergy_(0.0f),
+        trimThreshold_(IR_TRIM_THRESHOLD_DB)
+    {
+        memset(slotHashes_, 0, sizeof(slotHashes_));
+    }
     
     void Init() {
-        // Initialize USB host
-        usbh_ = new USBHostHandle();
-        usbh_->Init(USBHostHandle::Config());
+        // Initialize USB host; the drive is mounted when its mass storage
+        // class comes up and unmounted when it is pulled
+        USBHostHandle::Config config;
+        config.class_active_callback = UsbClassActive;
+        config.disconnect_callback = UsbDisconnect;
+        config.userdata = this;
+        usbh_.Init(config);
+        usbReady_ = true;
+        fsi_.Init(FatFSInterface::Config::MEDIA_USB);
     }
     
     void Process() {
         // Process USB host events
-        if (usbh_) {
-            usbh_->Process();
-            
-            // Check if USB drive is mounted
-            // In newer API, we need to check if the filesystem is ready
-            bool mounted = f_mount(nullptr, "", 0) == FR_OK;
-            
-            // If mount state changed
-            if (mounted != mounted_) {
-                mounted_ = mounted;
-                
-                // If newly mounted, try to load IR
-                if (mounted_) {
-                    LoadIR();
-                }
+        if (usbReady_) {
+            usbh_.Process();
+            
+            // Mount state only changes on host events, so FatFs is not
+            // touched while no drive comes or goes
+            if (usbDisconnected_) {
+                usbDisconnected_ = false;
+                Unmount();
             }
+            if (usbActive_) {
+                usbActive_ = false;
+                Mount();
+            }
+        }
+        
+        // Advance the load in progress by one slice
+        switch (state_) {
+        case LOAD_IDLE: break;
+        case LOAD_CLEAR: Clear(); break;
+        case LOAD_SCAN: Scan(); break;
+        case LOAD_NEXT_SET: NextSet(); break;
+        case LOAD_EBIR_SAMPLES: ReadEbirSamples(); break;
+        case LOAD_EBIR_SPECTRA: ImportEbirSpectra(); break;
+        case LOAD_WAV_OPEN: OpenWav(); break;
+        case LOAD_WAV_DECODE: DecodeWav(); break;
+        case LOAD_PEAK: FindPeak(); break;
+        case LOAD_TRIM: Trim(); break;
+        case LOAD_SCALE: Scale(); break;
+        case LOAD_SAVE: Save(); break;
         }
     }
     
-    bool LoadIR() {
-        if (!usbh_ || !mounted_) {
+    // Start loading all IRs from the drive into fresh slots. Returns false
+    // if there is no drive or a load is already running.
+    bool StartLoad() {
+        if (!usbReady_ || !mounted_ || state_ != LOAD_IDLE || !ClearIRSlotsCallback) {
             return false;
         }
         
-        // Try to load mono IR first
-        if (LoadMonoIR()) {
-            return true;
+        result_ = LOAD_NONE;
+        state_ = LOAD_CLEAR;
+        return true;
+    }
+    
+    // A load is running, including the .ebir writes between its IRs
+    bool Loading() const {
+        return state_ != LOAD_IDLE;
+    }
+    
+    // Outcome of the load that finished last, reported once: LOAD_OK if it
+    // filled at least one slot
+    LoadResult TakeResult() {
+        LoadResult result = result_;
+        result_ = LOAD_NONE;
+        return result;
+    }
+    
+    // Decay level in dB below which decoded IR tails are trimmed (0: keep
+    // WAV IRs whole). Takes effect from the next load; .ebir files keep
+    // the length they were written with.
+    void SetTrimThreshold(float thresholdDb) {
+        trimThreshold_ = (thresholdDb < 0.0f) ? thresholdDb : 0.0f;
+    }
+    
+    // Source hash of the IR loaded into slot (0: none or unknown)
+    uint32_t SlotSourceHash(size_t slot) const {
+        return (slot < IR_SLOTS) ? slotHashes_[slot] : 0;
+    }
+    
+    // Set callback for emptying the IR slots before a load; returns false
+    // while that is not possible yet
+    typedef bool (*ClearIRSlotsCallbackFn)();
+    static ClearIRSlotsCallbackFn ClearIRSlotsCallback;
+    
+    // Set callback for loading IR into a slot. Slots are filled in order
+    // from 0.
+    typedef bool (*LoadIRCallbackFn)(size_t slot, float* bufferL, float* bufferR, size_t length);
+    static LoadIRCallbackFn LoadIRCallback;
+    
+    // Set callback for loading a true-stereo IR matrix into a slot
+    typedef bool (*LoadTrueStereoIRCallbackFn)(size_t slot, float* ll, float* lr, float* rl, float* rr, size_t length);
+    static LoadTrueStereoIRCallbackFn LoadTrueStereoIRCallback;
+    
+    // Set callbacks for loading an IR with precomputed spectra into a slot.
+    // The first takes the header and the time-domain IR (paths), the second
+    // streams a slice of the spectra that follow per call.
+    typedef bool (*LoadPrecomputedIRCallbackFn)(size_t slot, const EbirHeader& header, float* const* paths);
+    static LoadPrecomputedIRCallbackFn LoadPrecomputedIRCallback;
+    typedef EbirStatus (*ImportPrecomputedIRCallbackFn)(EbirReadFn read, void* context);
+    static ImportPrecomputedIRCallbackFn ImportPrecomputedIRCallback;
+    
+    // Set callback for writing a loaded slot as an .ebir file, a slice per call
+    typedef EbirStatus (*SavePrecomputedIRCallbackFn)(size_t slot, EbirWriteFn write, void* context, uint32_t sourceHash);
+    static SavePrecomputedIRCallbackFn SavePrecomputedIRCallback;
+    
+private:
+    enum LoadState {
+        LOAD_IDLE,
+        LOAD_CLEAR,         // Empty the reverb's IR slots
+        LOAD_SCAN,          // List the IR directory an entry at a time
+        LOAD_NEXT_SET,      // Try the next IR file set or directory entry
+        LOAD_EBIR_SAMPLES,  // Read an .ebir file's time-domain IR
+        LOAD_EBIR_SPECTRA,  // Stream its spectra into the reverb
+        LOAD_WAV_OPEN,      // Open the next WAV file of the set
+        LOAD_WAV_DECODE,    // Decode it a chunk at a time
+        LOAD_PEAK,          // Find the common peak and energy
+        LOAD_TRIM,          // Scan the decay back from the end for the trim point
+        LOAD_SCALE,         // Normalize and publish
+        LOAD_SAVE           // Write the .ebir file
+    };
+    
+    // Decode step count that takes the layout from the file's channels
+    static const uint16_t CHANNELS_FROM_FILE = 0xFFFF;
+    
+    // One WAV file to decode: from channel on into count load buffers
+    // starting at buffer, or all channels mixed down with count 0
+    struct DecodeStep {
+        const char* name;
+        uint16_t channel;   // Falls back to the last channel of a single-channel read
+        uint16_t count;
+        size_t buffer;
+    };
+    
+    USBHostHandle usbh_;            // Held here rather than on the heap
+    bool usbReady_;
+    FatFSInterface fsi_;
+    bool mounted_;
+    volatile bool usbActive_;       // Set by the host callbacks
+    volatile bool usbDisconnected_;
+    
+    LoadState state_;
+    LoadResult result_;
+    size_t set_;                // IR_FILE_SETS entry, then IR_SETS + directory entry
+    size_t slot_;               // Slot the next IR goes to
+    
+    DIR dir_;
+    bool dirOpen_;
+    char entries_[IR_SLOTS][IR_NAME_LENGTH]; // Base names, sorted
+    size_t entryCount_;
+    char wavName_[sizeof(IR_DIRECTORY) + IR_NAME_LENGTH + 4];
+    char ebirNameBuffer_[sizeof(IR_DIRECTORY) + IR_NAME_LENGTH + 5];
+    const char* ebirName_;      // .ebir file of the IR being loaded
+    uint32_t sourceHash_;
+    uint32_t slotHashes_[IR_SLOTS]; // sourceHash_ of each filled slot
+    FIL file_;
+    bool fileOpen_;
+    WavReader wav_;
+    EbirHeader header_;
+    
+    // Load buffers of the set, in the order the reverb callback takes them
+    float* buffers_[4];
+    size_t bufferCount_;
+    
+    DecodeStep steps_[4];
+    size_t stepCount_;
+    size_t step_;
+    uint16_t channel_;          // Channel the current step reads from
+    uint32_t stepFrames_;       // Frames of the current file
+    uint32_t frames_;           // IR length: shortest file of the set
+    
+    size_t path_;
+    uint32_t pos_;              // Frames done in the current stage
+    float peak_;
+    float energy_;              // Sum of squares of all buffers
+    float tailEnergy_;          // Of the frames from pos_ on while trimming
+    float trimThreshold_;
+    
+    static bool ReadFile(void* context, void* data, size_t bytes) {
+        UINT bytesRead;
+        return f_read(static_cast<FIL*>(context), data, bytes, &bytesRead) == FR_OK && bytesRead == bytes;
+    }
+    
+    static bool WriteFile(void* context, const void* data, size_t bytes) {
+        UINT bytesWritten;
+        return f_write(static_cast<FIL*>(context), data, bytes, &bytesWritten) == FR_OK && bytesWritten == bytes;
+    }
+    
+    void CloseFile() {
+        if (fileOpen_) {
+            f_close(&file_);
+            fileOpen_ = false;
         }
-        
-        // If mono IR not found, try to load stereo IR
-        return LoadStereoIR();
     }
     
-    bool LoadMonoIR() {
-        // Open file
-        FIL file;
-        FRESULT result = f_open(&file, "ir_mono.wav", FA_READ);
-        
-        if (result != FR_OK) {
-            return false;
+    void Finish(LoadResult result) {
+        result_ = result;
+        state_ = LOAD_IDLE;
+    }
+    
+    // Give up on the current set and try the next one
+    void FailSet() {
+        CloseFile();
+        set_++;
+        state_ = LOAD_NEXT_SET;
+    }
+    
+    static void UsbClassActive(void* data) {
+        static_cast<IRLoader*>(data)->usbActive_ = true;
+    }
+    
+    static void UsbDisconnect(void* data) {
+        static_cast<IRLoader*>(data)->usbDisconnected_ = true;
+    }
+    
+    // Mount a newly enumerated drive and load its IRs
+    void Mount() {
+        mounted_ = f_mount(&fsi_.GetUSBFileSystem(), fsi_.GetUSBPath(), 1) == FR_OK;
+        if (mounted_) {
+            StartLoad();
+        }
+    }
+    
+    // A load still running then finds no more files and ends with the
+    // slots it has filled
+    void Unmount() {
+        if (mounted_) {
+            f_mount(nullptr, fsi_.GetUSBPath(), 0);
+            mounted_ = false;
+        }
+    }
+    
+    // The current set filled slot_; only one root set is used
+    void NextSlot() {
+        slot_++;
+        set_ = (set_ < IR_SETS) ? IR_SETS : set_ + 1;
+        state_ = LOAD_NEXT_SET;
+    }
+    
+    void Clear() {
+        if (!ClearIRSlotsCallback()) {
+            return;
         }
         
-        // Read WAV header
-        WAVHeader header;
-        UINT bytesRead;
-        result = f_read(&file, &header, sizeof(WAVHeader), &bytesRead);
-        
-        if (result != FR_OK || bytesRead != sizeof(WAVHeader)) {
-            f_close(&file);
-            return false;
+        set_ = 0;
+        slot_ = 0;
+        entryCount_ = 0;
+        memset(slotHashes_, 0, sizeof(slotHashes_));
+        dirOpen_ = f_opendir(&dir_, IR_DIRECTORY) == FR_OK;
+        state_ = LOAD_SCAN;
+    }
+    
+    // Collect the IR base names in the directory, keeping the first
+    // IR_SLOTS in name order
+    void Scan() {
+        FILINFO info;
+        if (!dirOpen_ || f_readdir(&dir_, &info) != FR_OK || info.fname[0] == 0) {
+            if (dirOpen_) {
+                f_closedir(&dir_);
+                dirOpen_ = false;
+            }
+            state_ = LOAD_NEXT_SET;
+            return;
+        }
+        if (info.fattrib & AM_DIR) {
+            return;
         }
         
-        // Check if valid WAV file
-        if (strncmp(header.riff, "RIFF", 4) != 0 || 
-            strncmp(header.wave, "WAVE", 4) != 0 || 
-            strncmp(header.fmt, "fmt ", 4) != 0 || 
-            strncmp(header.data, "data", 4) != 0) {
-            f_close(&file);
-            return false;
+        size_t length = strlen(info.fname);
+        size_t base;
+        if (HasExtension(info.fname, length, ".wav")) {
+            base = length - 4;
+        } else if (HasExtension(info.fname, length, ".ebir")) {
+            base = length - 5;
+        } else {
+            return;
+        }
+        if (base == 0 || base >= IR_NAME_LENGTH) {
+            return;
         }
+        info.fname[base] = 0;
         
-        // Check if supported format (PCM)
-        if (header.audioFormat != 1) {
-            f_close(&file);
+        // Insertion into the sorted list; an .ebir and its WAV are one IR
+        size_t pos = 0;
+        while (pos < entryCount_ && strcmp(entries_[pos], info.fname) < 0) {
+            pos++;
+        }
+        if (pos == IR_SLOTS || (pos < entryCount_ && strcmp(entries_[pos], info.fname) == 0)) {
+            return;
+        }
+        size_t last = (entryCount_ < IR_SLOTS) ? entryCount_++ : IR_SLOTS - 1;
+        for (size_t i = last; i > pos; i--) {
+            memcpy(entries_[i], entries_[i - 1], IR_NAME_LENGTH);
+        }
+        memcpy(entries_[pos], info.fname, base + 1);
+    }
+    
+    static bool HasExtension(const char* name, size_t length, const char* extension) {
+        size_t count = strlen(extension);
+        if (length <= count) {
             return false;
         }
-        
-        // Calculate number of samples
-        uint32_t numSamples = header.dataSize / (header.numChannels * (header.bitsPerSample / 8));
-        
-        // Limit to MAX_IR_LENGTH
-        if (numSamples > MAX_IR_LENGTH) {
-            numSamples = MAX_IR_LENGTH;
+        for (size_t i = 0; i < count; i++) {
+            char c = name[length - count + i];
+            if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+            if (c != extension[i]) return false;
+        }
+        return true;
+    }
+    
+    // Number of samples from pos_ handled in one slice of a stage of length
+    uint32_t Slice(uint32_t length) const {
+        uint32_t count = length - pos_;
+        return (count > IR_LOAD_SLICE) ? IR_LOAD_SLICE : count;
+    }
+    
+    void NextSet() {
+        if (slot_ == IR_SLOTS || set_ == IR_SETS + entryCount_) {
+            Finish((slot_ > 0) ? LOAD_OK : LOAD_FAILED);
+            return;
         }
         
-        // Allocate buffer
-        float* irBuffer = new float[numSamples];
+        if (set_ < IR_SETS) {
+            const IrFileSet& set = IR_FILE_SETS[set_];
+            ebirName_ = set.ebir;
+            sourceHash_ = SourceHash(set.sources, set.sourceCount);
+        } else {
+            const char* base = entries_[set_ - IR_SETS];
+            snprintf(wavName_, sizeof(wavName_), "%s/%s.wav", IR_DIRECTORY, base);
+            snprintf(ebirNameBuffer_, sizeof(ebirNameBuffer_), "%s/%s.ebir", IR_DIRECTORY, base);
+            ebirName_ = ebirNameBuffer_;
+            const char* sources[] = {wavName_};
+            sourceHash_ = SourceHash(sources, 1);
+        }
         
-        if (!irBuffer) {
-            f_close(&file);
+        if (!OpenEbir(ebirName_)) {
+            PlanWav();
+        }
+    }
+    
+    // Open an .ebir file and check its header. sourceHash_ identifies the
+    // WAV file(s) it was made from (0 if they are gone, in which case any
+    // valid file is used).
+    bool OpenEbir(const char* name) {
+        if (!LoadPrecomputedIRCallback || !ImportPrecomputedIRCallback ||
+            f_open(&file_, name, FA_READ) != FR_OK) {
             return false;
         }
-        
-        // Read samples
-        if (header.bitsPerSample == 16) {
-            // 16-bit samples
-            int16_t* tempBuffer = new int16_t[numSamples * header.numChannels];
-            
-            if (!tempBuffer) {
-                delete[] irBuffer;
-                f_close(&file);
-                return false;
-            }
-            
-            result = f_read(&file, tempBuffer, numSamples * header.numChannels * sizeof(int16_t), &bytesRead);
-            
-            if (result != FR_OK) {
-                delete[] tempBuffer;
-                delete[] irBuffer;
-                f_close(&file);
-                return false;
-            }
-            
-            // Convert to float
-            for (uint32_t i = 0; i < numSamples; i++) {
-                // If stereo, average channels
-                if (header.numChannels == 2) {
-                    irBuffer[i] = ((float)tempBuffer[i*2] + (float)tempBuffer[i*2+1]) / 65536.0f;
-                } else {
-                    irBuffer[i] = (float)tempBuffer[i] / 32768.0f;
-                }
-            }
-            
-            delete[] tempBuffer;
-        } else if (header.bitsPerSample == 24) {
-            // 24-bit samples
-            uint8_t* tempBuffer = new uint8_t[numSamples * header.numChannels * 3];
-            
-            if (!tempBuffer) {
-                delete[] irBuffer;
-                f_close(&file);
-                return false;
-            }
-            
-            result = f_read(&file, tempBuffer, numSamples * header.numChannels * 3, &bytesRead);
-            
-            if (result != FR_OK) {
-                delete[] tempBuffer;
-                delete[] irBuffer;
-                f_close(&file);
-                return false;
-            }
-            
-            // Convert to float
-            for (uint32_t i = 0; i < numSamples; i++) {
-                // If stereo, average channels
-                if (header.numChannels == 2) {
-                    int32_t sampleL = (tempBuffer[i*6] << 8) | (tempBuffer[i*6+1] << 16) | (tempBuffer[i*6+2] << 24);
-                    int32_t sampleR = (tempBuffer[i*6+3] << 8) | (tempBuffer[i*6+4] << 16) | (tempBuffer[i*6+5] << 24);
-                    sampleL >>= 8;
-                    sampleR >>= 8;
-                    irBuffer[i] = ((float)sampleL + (float)sampleR) / 16777216.0f;
-                } else {
-                    int32_t sample = (tempBuffer[i*3] << 8) | (tempBuffer[i*3+1] << 16) | (tempBuffer[i*3+2] << 24);
-                    sample >>= 8;
-                    irBuffer[i] = (float)sample / 8388608.0f;
-                }
-            }
-            
-            delete[] tempBuffer;
-        } else if (header.bitsPerSample == 32) {
-            // 32-bit samples (assume float)
-            result = f_read(&file, irBuffer, numSamples * sizeof(float), &bytesRead);
-            
-            if (result != FR_OK) {
-                delete[] irBuffer;
-                f_close(&file);
-                return false;
-            }
-        } else {
-            // Unsupported bit depth
-            delete[] irBuffer;
-            f_close(&file);
+        fileOpen_ = true;
+        
+        bool ok = ReadFile(&file_, &header_, sizeof(header_)) &&
+                  memcmp(header_.magic, EBIR_MAGIC, sizeof(header_.magic)) == 0 &&
+                  header_.version == EBIR_VERSION &&
+                  (sourceHash_ == 0 || header_.sourceHash == sourceHash_) &&
+                  header_.paths > 0 && header_.paths <= 4 &&
+                  header_.length > 0 && header_.length <= MAX_IR_LENGTH;
+        if (!ok) {
+            CloseFile();
             return false;
         }
         
-        // Close file
-        f_close(&file);
+        // Time-domain IR, in path order LL, RR, LR, RL
+        buffers_[0] = g_irLoadBufferL;
+        buffers_[1] = g_irLoadBufferR;
+        buffers_[2] = g_irLoadBufferLR;
+        buffers_[3] = g_irLoadBufferRL;
+        path_ = 0;
+        pos_ = 0;
+        state_ = LOAD_EBIR_SAMPLES;
+        return true;
+    }
+    
+    void ReadEbirSamples() {
+        uint32_t count = Slice(header_.length);
+        if (!ReadFile(&file_, buffers_[path_] + pos_, count * sizeof(float))) {
+            CloseFile();
+            PlanWav();
+            return;
+        }
         
-        // Normalize IR
-        float maxAbs = 0.0f;
-        for (uint32_t i = 0; i < numSamples; i++) {
-            float absVal = fabsf(irBuffer[i]);
-            if (absVal > maxAbs) {
-                maxAbs = absVal;
-            }
+        pos_ += count;
+        if (pos_ < header_.length) {
+            return;
+        }
+        pos_ = 0;
+        if (++path_ < header_.paths) {
+            return;
         }
         
-        if (maxAbs > 0.0f) {
-            for (uint32_t i = 0; i < numSamples; i++) {
-                irBuffer[i] /= maxAbs;
+        if (!LoadPrecomputedIRCallback(slot_, header_, buffers_)) {
+            CloseFile();
+            PlanWav();
+            return;
+        }
+        slotHashes_[slot_] = header_.sourceHash;
+        state_ = LOAD_EBIR_SPECTRA;
+    }
+    
+    void ImportEbirSpectra() {
+        // A read error makes the reverb transform the IR itself, which
+        // still counts as loaded
+        if (ImportPrecomputedIRCallback(ReadFile, &file_) == EBIR_BUSY) {
+            return;
+        }
+        CloseFile();
+        NextSlot();
+    }
+    
+    // Set up decoding the WAV file(s) of the current set
+    void PlanWav() {
+        stepCount_ = 0;
+        switch (set_) {
+        case IR_SET_MONO:
+            // A multichannel file is mixed down to mono
+            buffers_[0] = g_irLoadBufferL;
+            bufferCount_ = 1;
+            AddStep("ir_mono.wav", 0, 0, 0);
+            break;
+            
+        case IR_SET_TRUE_STEREO: {
+            // One 4-channel file (channel order LL, LR, RL, RR - input then
+            // output) or four mono files
+            buffers_[0] = g_irLoadBufferL;
+            buffers_[1] = g_irLoadBufferLR;
+            buffers_[2] = g_irLoadBufferRL;
+            buffers_[3] = g_irLoadBufferR;
+            bufferCount_ = 4;
+            
+            FILINFO info;
+            if (f_stat("ir_true_stereo.wav", &info) == FR_OK) {
+                AddStep("ir_true_stereo.wav", 0, 4, 0);
+            } else {
+                const char* names[4] = {"ir_ll.wav", "ir_lr.wav", "ir_rl.wav", "ir_rr.wav"};
+                for (size_t path = 0; path < 4; path++) {
+                    AddStep(names[path], 0, 1, path);
+                }
             }
+            break;
         }
         
-        // Load IR into reverb
-        bool success = LoadIRCallback(irBuffer, nullptr, numSamples);
-        
-        // Free buffer
-        delete[] irBuffer;
+        case IR_SET_STEREO:
+            // A stereo file contributes its left channel to the left IR and
+            // its right channel to the right IR
+            buffers_[0] = g_irLoadBufferL;
+            buffers_[1] = g_irLoadBufferR;
+            bufferCount_ = 2;
+            AddStep("ir_left.wav", 0, 1, 0);
+            AddStep("ir_right.wav", 1, 1, 1);
+            break;
+            
+        default:
+            // Buffers are picked once the channel count is known
+            AddStep(wavName_, 0, CHANNELS_FROM_FILE, 0);
+            break;
+        }
         
-        return success;
+        step_ = 0;
+        frames_ = 0;
+        state_ = LOAD_WAV_OPEN;
     }
     
-    bool LoadStereoIR() {
-        // Open left channel file
-        FIL fileL;
-        FRESULT result = f_open(&fileL, "ir_left.wav", FA_READ);
-        
-        if (result != FR_OK) {
-            return false;
+    void AddStep(const char* name, uint16_t channel, uint16_t count, size_t buffer) {
+        DecodeStep& step = steps_[stepCount_++];
+        step.name = name;
+        step.channel = channel;
+        step.count = count;
+        step.buffer = buffer;
+    }
+    
+    void OpenWav() {
+        DecodeStep& step = steps_[step_];
+        if (f_open(&file_, step.name, FA_READ) != FR_OK) {
+            FailSet();
+            return;
         }
+        fileOpen_ = true;
         
-        // Open right channel file
-        FIL fileR;
-        result = f_open(&fileR, "ir_right.wav", FA_READ);
-        
-        if (result != FR_OK) {
-            f_close(&fileL);
-            return false;
+        if (!wav_.Open(&file_)) {
+            FailSet();
+            return;
         }
-        
-        // Read WAV headers
-        WAVHeader headerL, headerR;
-        UINT bytesReadL, bytesReadR;
-        
-        result = f_read(&fileL, &headerL, sizeof(WAVHeader), &bytesReadL);
-        if (result != FR_OK || bytesReadL != sizeof(WAVHeader)) {
-            f_close(&fileL);
-            f_close(&fileR);
-            return false;
+        if (step.count == CHANNELS_FROM_FILE) {
+            PlanChannels(step);
         }
-        
-        result = f_read(&fileR, &headerR, sizeof(WAVHeader), &bytesReadR);
-        if (result != FR_OK || bytesReadR != sizeof(WAVHeader)) {
-            f_close(&fileL);
-            f_close(&fileR);
-            return false;
+        if (step.count > 1 && wav_.Channels() != step.count) {
+            FailSet();
+            return;
         }
         
-        // Check if valid WAV files
-        if (strncmp(headerL.riff, "RIFF", 4) != 0 || 
-            strncmp(headerL.wave, "WAVE", 4) != 0 || 
-            strncmp(headerL.fmt, "fmt ", 4) != 0 || 
-            strncmp(headerL.data, "data", 4) != 0 ||
-            strncmp(headerR.riff, "RIFF", 4) != 0 || 
-            strncmp(headerR.wave, "WAVE", 4) != 0 || 
-            strncmp(headerR.fmt, "fmt ", 4) != 0 || 
-            strncmp(headerR.data, "data", 4) != 0) {
-            f_close(&fileL);
-            f_close(&fileR);
-            return false;
+        channel_ = step.channel;
+        if (step.count == 1 && channel_ >= wav_.Channels()) {
+            channel_ = wav_.Channels() - 1;
         }
         
-        // Check if supported format (PCM)
-        if (headerL.audioFormat != 1 || headerR.audioFormat != 1) {
-            f_close(&fileL);
-            f_close(&fileR);
-            return false;
+        // All responses share the shortest length
+        stepFrames_ = LimitLength(wav_.Frames());
+        if (step_ == 0 || stepFrames_ < frames_) {
+            frames_ = stepFrames_;
+        }
+        pos_ = 0;
+        state_ = LOAD_WAV_DECODE;
+    }
+    
+    // Layout of a directory IR: one WAV file read with all its channels
+    void PlanChannels(DecodeStep& step) {
+        switch (wav_.Channels()) {
+        case 2:
+            buffers_[0] = g_irLoadBufferL;
+            buffers_[1] = g_irLoadBufferR;
+            bufferCount_ = 2;
+            step.count = 2;
+            break;
+            
+        case 4:
+            // Channel order LL, LR, RL, RR as in ir_true_stereo.wav
+            buffers_[0] = g_irLoadBufferL;
+            buffers_[1] = g_irLoadBufferLR;
+            buffers_[2] = g_irLoadBufferRL;
+            buffers_[3] = g_irLoadBufferR;
+            bufferCount_ = 4;
+            step.count = 4;
+            break;
+            
+        default:
+            // Mono, or mixed down to mono
+            buffers_[0] = g_irLoadBufferL;
+            bufferCount_ = 1;
+            step.count = (wav_.Channels() == 1) ? 1 : 0;
+            break;
+        }
+    }
+    
+    void DecodeWav() {
+        const DecodeStep& step = steps_[step_];
+        uint32_t count = stepFrames_ - pos_;
+        if (count > wav_.ChunkFrames()) {
+            count = wav_.ChunkFrames();
         }
         
-        // Calculate number of samples
-        uint32_t numSamplesL = headerL.dataSize / (headerL.numChannels * (headerL.bitsPerSample / 8));
-        uint32_t numSamplesR = headerR.dataSize / (headerR.numChannels * (headerR.bitsPerSample / 8));
-        
-        // Use the smaller of the two
-        uint32_t numSamples = (numSamplesL < numSamplesR) ? numSamplesL : numSamplesR;
-        
-        // Limit to MAX_IR_LENGTH
-        if (numSamples > MAX_IR_LENGTH) {
-            numSamples = MAX_IR_LENGTH;
+        float* outs[4];
+        size_t outCount = (step.count > 0) ? step.count : 1;
+        for (size_t c = 0; c < outCount; c++) {
+            outs[c] = buffers_[step.buffer + c] + pos_;
         }
         
-        // Allocate buffers
-        float* irBufferL = new float[numSamples];
-        float* irBufferR = new float[numSamples];
+        bool ok = (step.count > 0) ? wav_.Read(outs, channel_, step.count, count)
+                                   : wav_.ReadMixed(outs[0], count);
+        if (!ok) {
+            FailSet();
+            return;
+        }
         
-        if (!irBufferL || !irBufferR) {
-            if (irBufferL) delete[] irBufferL;
-            if (irBufferR) delete[] irBufferR;
-            f_close(&fileL);
-            f_close(&fileR);
-            return false;
+        pos_ += count;
+        if (pos_ < stepFrames_) {
+            return;
         }
         
-        // Read samples from left channel
-        if (headerL.bitsPerSample == 16) {
-            // 16-bit samples
-            int16_t* tempBuffer = new int16_t[numSamples * headerL.numChannels];
-            
-            if (!tempBuffer) {
-                delete[] irBufferL;
-                delete[] irBufferR;
-                f_close(&fileL);
-                f_close(&fileR);
-                return false;
-            }
-            
-            result = f_read(&fileL, tempBuffer, numSamples * headerL.numChannels * sizeof(int16_t), &bytesReadL);
-            
-            if (result != FR_OK) {
-                delete[] tempBuffer;
-                delete[] irBufferL;
-                delete[] irBufferR;
-                f_close(&fileL);
-                f_close(&fileR);
-                return false;
-            }
-            
-            // Convert to float
-            for (uint32_t i = 0; i < numSamples; i++) {
-                // If stereo, use left channel
-                if (headerL.numChannels == 2) {
-                    irBufferL[i] = (float)tempBuffer[i*2] / 32768.0f;
-                } else {
-                    irBufferL[i] = (float)tempBuffer[i] / 32768.0f;
-                }
-            }
-            
-            delete[] tempBuffer;
-        } else if (headerL.bitsPerSample == 24) {
-            // 24-bit samples
-            uint8_t* tempBuffer = new uint8_t[numSamples * headerL.numChannels * 3];
-            
-            if (!tempBuffer) {
-                delete[] irBufferL;
-                delete[] irBufferR;
-                f_close(&fileL);
-                f_close(&fileR);
-                return false;
-            }
-            
-            result = f_read(&fileL, tempBuffer, numSamples * headerL.numChannels * 3, &bytesReadL);
-            
-            if (result != FR_OK) {
-                delete[] tempBuffer;
-                delete[] irBufferL;
-                delete[] irBufferR;
-                f_close(&fileL);
-                f_close(&fileR);
-                return false;
-            }
-            
-            // Convert to float
-            for (uint32_t i = 0; i < numSamples; i++) {
-                // If stereo, use left channel
-                if (headerL.numChannels == 2) {
-                    int32_t sample = (tempBuffer[i*6] << 8) | (tempBuffer[i*6+1] << 16) | (tempBuffer[i*6+2] << 24);
-                    sample >>= 8;
-                    irBufferL[i] = (float)sample / 8388608.0f;
-                } else {
-                    int32_t sample = (tempBuffer[i*3] << 8) | (tempBuffer[i*3+1] << 16) | (tempBuffer[i*3+2] << 24);
-                    sample >>= 8;
-                    irBufferL[i] = (float)sample / 8388608.0f;
-                }
-            }
-            
-            delete[] tempBuffer;
-        } else if (headerL.bitsPerSample == 32) {
-            // 32-bit samples (assume float)
-            result = f_read(&fileL, irBufferL, numSamples * sizeof(float), &bytesReadL);
-            
-            if (result != FR_OK) {
-                delete[] irBufferL;
-                delete[] irBufferR;
-                f_close(&fileL);
-                f_close(&fileR);
-                return false;
-            }
+        CloseFile();
+        if (++step_ < stepCount_) {
+            state_ = LOAD_WAV_OPEN;
+        } else if (frames_ == 0) {
+            FailSet();
         } else {
-            // Unsupported bit depth
-            delete[] irBufferL;
-            delete[] irBufferR;
-            f_close(&fileL);
-            f_close(&fileR);
-            return false;
+            pos_ = 0;
+            peak_ = 0.0f;
+            energy_ = 0.0f;
+            state_ = LOAD_PEAK;
         }
-        
-        // Read samples from right channel
-        if (headerR.bitsPerSample == 16) {
-            // 16-bit samples
-            int16_t* tempBuffer = new int16_t[numSamples * headerR.numChannels];
-            
-            if (!tempBuffer) {
-                delete[] irBufferL;
-                delete[] irBufferR;
-                f_close(&fileL);
-                f_close(&fileR);
-                return false;
-            }
-            
-            result = f_read(&fileR, tempBuffer, numSamples * headerR.numChannels * sizeof(int16_t), &bytesReadR);
-            
-            if (result != FR_OK) {
-                delete[] tempBuffer;
-                delete[] irBufferL;
-                delete[] irBufferR;
-                f_close(&fileL);
-                f_close(&fileR);
-                return false;
-            }
-            
-            // Convert to float
-            for (uint32_t i = 0; i < numSamples; i++) {
-                // If stereo, use right channel
-                if (headerR.numChannels == 2) {
-                    irBufferR[i] = (float)tempBuffer[i*2+1] / 32768.0f;
-                } else {
-                    irBufferR[i] = (float)tempBuffer[i] / 32768.0f;
-                }
-            }
-            
-            delete[] tempBuffer;
-        } else if (headerR.bitsPerSample == 24) {
-            // 24-bit samples
-            uint8_t* tempBuffer = new uint8_t[numSamples * headerR.numChannels * 3];
-            
-            if (!tempBuffer) {
-                delete[] irBufferL;
-                delete[] irBufferR;
-                f_close(&fileL);
-                f_close(&fileR);
-                return false;
-            }
-            
-            result = f_read(&fileR, tempBuffer, numSamples * headerR.numChannels * 3, &bytesReadR);
-            
-            if (result != FR_OK) {
-                delete[] tempBuffer;
-                delete[] irBufferL;
-                delete[] irBufferR;
-                f_close(&fileL);
-                f_close(&fileR);
-                return false;
-            }
-            
-            // Convert to float
-            for (uint32_t i = 0; i < numSamples; i++) {
-                // If stereo, use right channel
-                if (headerR.numChannels == 2) {
-                    int32_t sample = (tempBuffer[i*6+3] << 8) | (tempBuffer[i*6+4] << 16) | (tempBuffer[i*6+5] << 24);
-                    sample >>= 8;
-                    irBufferR[i] = (float)sample / 8388608.0f;
-                } else {
-                    int32_t sample = (tempBuffer[i*3] << 8) | (tempBuffer[i*3+1] << 16) | (tempBuffer[i*3+2] << 24);
-                    sample >>= 8;
-                    irBufferR[i] = (float)sample / 8388608.0f;
+    }
+    
+    // Normalize all buffers by their common peak to keep their balance,
+    // and trim them together where their combined decay ends
+    void FindPeak() {
+        uint32_t count = Slice(frames_);
+        float energy = 0.0f;
+        for (size_t b = 0; b < bufferCount_; b++) {
+            const float* buffer = buffers_[b] + pos_;
+            for (uint32_t i = 0; i < count; i++) {
+                float absVal = fabsf(buffer[i]);
+                if (absVal > peak_) {
+                    peak_ = absVal;
                 }
+                energy += buffer[i] * buffer[i];
             }
-            
-            delete[] tempBuffer;
-        } else if (headerR.bitsPerSample == 32) {
-            // 32-bit samples (assume float)
-            result = f_read(&fileR, irBufferR, numSamples * sizeof(float), &bytesReadR);
-            
-            if (result != FR_OK) {
-                delete[] irBufferL;
-                delete[] irBufferR;
-                f_close(&fileL);
-                f_close(&fileR);
-                return false;
-            }
-        } else {
-            // Unsupported bit depth
-            delete[] irBufferL;
-            delete[] irBufferR;
-            f_close(&fileL);
-            f_close(&fileR);
-            return false;
         }
+        energy_ += energy;
         
-        // Close files
-        f_close(&fileL);
-        f_close(&fileR);
-        
-        // Normalize IRs
-        float maxAbsL = 0.0f;
-        float maxAbsR = 0.0f;
+        pos_ += count;
+        if (pos_ < frames_) {
+            return;
+        }
         
-        for (uint32_t i = 0; i < numSamples; i++) {
-            float absValL = fabsf(irBufferL[i]);
-            float absValR = fabsf(irBufferR[i]);
-            
-            if (absValL > maxAbsL) {
-                maxAbsL = absValL;
+        pos_ = 0;
+        if (peak_ == 0.0f) {
+            Publish();
+            return;
+        }
+        peak_ = 1.0f / peak_;
+        if (trimThreshold_ < 0.0f) {
+            pos_ = frames_;
+            tailEnergy_ = 0.0f;
+            state_ = LOAD_TRIM;
+        } else {
+            state_ = LOAD_SCALE;
+        }
+    }
+    
+    // Schroeder integration from the end: sum the energy backwards a slice
+    // at a time until it exceeds the threshold's share of the whole, which
+    // is where the kept IR ends
+    void Trim() {
+        const float limit = energy_ * powf(10.0f, trimThreshold_ * 0.1f);
+        uint32_t count = (pos_ > IR_LOAD_SLICE) ? IR_LOAD_SLICE : pos_;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t frame = pos_ - 1;
+            float energy = 0.0f;
+            for (size_t b = 0; b < bufferCount_; b++) {
+                energy += buffers_[b][frame] * buffers_[b][frame];
             }
-            
-            if (absValR > maxAbsR) {
-                maxAbsR = absValR;
+            tailEnergy_ += energy;
+            if (tailEnergy_ > limit) {
+                TrimAt(frame + 1);
+                return;
             }
+            pos_ = frame;
         }
         
-        // Use the larger of the two for normalization
-        float maxAbs = (maxAbsL > maxAbsR) ? maxAbsL : maxAbsR;
-        
-        if (maxAbs > 0.0f) {
-            for (uint32_t i = 0; i < numSamples; i++) {
-                irBufferL[i] /= maxAbs;
-                irBufferR[i] /= maxAbs;
+        if (pos_ == 0) {
+            TrimAt(frames_);
+        }
+    }
+    
+    // Keep the first end frames (at least the fade's worth), fading out
+    // the last IR_TRIM_FADE of them
+    void TrimAt(uint32_t end) {
+        if (end < IR_TRIM_FADE) {
+            end = (frames_ < IR_TRIM_FADE) ? frames_ : IR_TRIM_FADE;
+        }
+        if (end < frames_) {
+            frames_ = end;
+            uint32_t fade = (frames_ < IR_TRIM_FADE) ? frames_ : IR_TRIM_FADE;
+            for (size_t b = 0; b < bufferCount_; b++) {
+                float* buffer = buffers_[b] + frames_ - fade;
+                for (uint32_t i = 0; i < fade; i++) {
+                    buffer[i] *= (float)(fade - i) / (fade + 1);
+                }
+            }
+        }
+        pos_ = 0;
+        state_ = LOAD_SCALE;
+    }
+    
+    void Scale() {
+        uint32_t count = Slice(frames_);
+        for (size_t b = 0; b < bufferCount_; b++) {
+            float* buffer = buffers_[b] + pos_;
+            for (uint32_t i = 0; i < count; i++) {
+                buffer[i] *= peak_;
             }
         }
         
-        // Load IR into reverb
-        bool success = LoadIRCallback(irBufferL, irBufferR, numSamples);
-        
-        // Free buffers
-        delete[] irBufferL;
-        delete[] irBufferR;
+        pos_ += count;
+        if (pos_ == frames_) {
+            Publish();
+        }
+    }
+    
+    // Hand the decoded IR to the reverb, then write its .ebir file before
+    // moving on to the next slot
+    void Publish() {
+        bool ok;
+        if (bufferCount_ == 4) {
+            ok = LoadTrueStereoIRCallback(slot_, buffers_[0], buffers_[1], buffers_[2], buffers_[3], frames_);
+        } else {
+            ok = LoadIRCallback(slot_, buffers_[0], (bufferCount_ == 2) ? buffers_[1] : nullptr, frames_);
+        }
+        if (!ok) {
+            FailSet();
+            return;
+        }
+        slotHashes_[slot_] = sourceHash_;
         
-        return success;
+        if (SavePrecomputedIRCallback &&
+            f_open(&file_, ebirName_, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK) {
+            fileOpen_ = true;
+            state_ = LOAD_SAVE;
+            return;
+        }
+        NextSlot();
     }
     
-    // Set callback for loading IR
-    typedef bool (*LoadIRCallbackFn)(float* bufferL, float* bufferR, size_t length);
-    static LoadIRCallbackFn LoadIRCallback;
+    // Write the .ebir file a slice at a time; a failed write is removed
+    void Save() {
+        EbirStatus status = SavePrecomputedIRCallback(slot_, WriteFile, &file_, sourceHash_);
+        if (status == EBIR_BUSY) {
+            return;
+        }
+        
+        bool ok = (f_close(&file_) == FR_OK) && status == EBIR_DONE;
+        fileOpen_ = false;
+        if (!ok) {
+            f_unlink(ebirName_);
+        }
+        NextSlot();
+    }
     
-private:
-    USBHostHandle* usbh_;
-    bool mounted_;
+    // Fingerprint of the files present out of names (size and modification
+    // time), or 0 if none of them exists
+    uint32_t SourceHash(const char* const* names, size_t count) {
+        uint32_t hash = EBIR_HASH_SEED;
+        bool found = false;
+        
+        for (size_t i = 0; i < count; i++) {
+            FILINFO info;
+            if (f_stat(names[i], &info) != FR_OK) {
+                continue;
+            }
+            found = true;
+            hash = EbirHash(hash, (uint32_t)i);
+            hash = EbirHash(hash, (uint32_t)info.fsize);
+            hash = EbirHash(hash, ((uint32_t)info.fdate << 16) | info.ftime);
+        }
+        
+        if (!found) {
+            return 0;
+        }
+        return (hash != 0) ? hash : 1;
+    }
     
-    // WAV file header structure
-    struct WAVHeader {
-        char riff[4];           // "RIFF"
-        uint32_t chunkSize;     // File size - 8
-        char wave[4];           // "WAVE"
-        char fmt[4];            // "fmt "
-        uint32_t fmtSize;       // Format chunk size
-        uint16_t audioFormat;   // Audio format (1 = PCM)
-        uint16_t numChannels;   // Number of channels
-        uint32_t sampleRate;    // Sample rate
-        uint32_t byteRate;      // Byte rate
-        uint16_t blockAlign;    // Block align
-        uint16_t bitsPerSample; // Bits per sample
-        char data[4];           // "data"
-        uint32_t dataSize;      // Data size
-    };
+    // Limit a decoded IR to MAX_IR_LENGTH
+    static uint32_t LimitLength(uint32_t frames) {
+        return (frames > MAX_IR_LENGTH) ? MAX_IR_LENGTH : frames;
+    }
 };
 
-// Initialize static member
+// Initialize static members
+IRLoader::ClearIRSlotsCallbackFn IRLoader::ClearIRSlotsCallback = nullptr;
 IRLoader::LoadIRCallbackFn IRLoader::LoadIRCallback = nullptr;
+IRLoader::LoadTrueStereoIRCallbackFn IRLoader::LoadTrueStereoIRCallback = nullptr;
+IRLoader::LoadPrecomputedIRCallbackFn IRLoader::LoadPrecomputedIRCallback = nullptr;
+IRLoader::ImportPrecomputedIRCallbackFn IRLoader::ImportPrecomputedIRCallback = nullptr;
+IRLoader::SavePrecomputedIRCallbackFn IRLoader::SavePrecomputedIRCallback = nullptr;
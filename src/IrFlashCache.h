@@ -0,0 +1,302 @@
+// Echo Bridge — High-quality convolution reverb for Daisy Seed
+// Copyright (C) 2025  Daniel Ramirez / LUFS Audio
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "daisy_seed.h"
+#include "EbirFile.h"
+#include <string.h>
+
+using namespace daisy;
+
+// Copy of the last-used IR in the Daisy Seed's 8MB QSPI flash, so the pedal
+// has its reverb back at power-up without a USB drive. The cache is one
+// .ebir stream behind a small commit header:
+//
+//   sector 0:  IrCacheHeader, written last
+//   sector 1+: EbirHeader, time-domain IR, spectra (as in an .ebir file)
+//
+// An IR whose spectra do not fit (a 4-second true-stereo IR) is cached as
+// its time-domain IR only, flagged by a zero layoutHash, and transformed on
+// boot instead. The firmware runs from internal flash and nothing else
+// reads QSPI, so the flash is free to leave memory-mapped mode for erasing
+// and programming while audio runs.
+static const uint32_t IR_CACHE_SECTOR = 4096;
+static const uint32_t IR_CACHE_SIZE = 8 * 1024 * 1024;
+static const uint32_t IR_CACHE_DATA = IR_CACHE_SECTOR;
+static const uint32_t IR_CACHE_CAPACITY = IR_CACHE_SIZE - IR_CACHE_DATA;
+
+static const char IR_CACHE_MAGIC[4] = {'E', 'B', 'Q', 'C'};
+static const uint32_t IR_CACHE_VERSION = 1;
+
+struct IrCacheHeader {
+    char magic[4];          // "EBQC"
+    uint32_t version;       // IR_CACHE_VERSION
+    uint32_t size;          // Bytes of .ebir stream from IR_CACHE_DATA
+    uint32_t checksum;      // IrCacheChecksum() of the stream past the EbirHeader, then the EbirHeader
+};
+
+// Fletcher-style sums over 32-bit words: two adds per word, so checking a
+// multi-megabyte cache at boot runs at QSPI read speed
+struct IrCacheChecksum {
+    uint32_t sum1;
+    uint32_t sum2;
+
+    IrCacheChecksum() : sum1(0), sum2(0) {}
+
+    void Add(const void* data, size_t bytes) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        for (; bytes >= 4; bytes -= 4, p += 4) {
+            uint32_t word;
+            memcpy(&word, p, sizeof(word));
+            sum1 += word;
+            sum2 += sum1;
+        }
+        for (; bytes > 0; bytes--, p++) {
+            sum1 += *p;
+            sum2 += sum1;
+        }
+    }
+
+    uint32_t Value() const {
+        return sum1 ^ (sum2 * 2654435761u);
+    }
+};
+
+// Reads the cached IR at boot and rewrites it, a slice per Process() call,
+// when another IR has become the one in use
+class IrFlashCache {
+public:
+    IrFlashCache() :
+        qspi_(nullptr),
+        state_(CACHE_IDLE),
+        cachedHash_(0),
+        slot_(0),
+        sourceHash_(0),
+        size_(0),
+        spectra_(false),
+        pos_(0),
+        readPos_(0),
+        readEnd_(0)
+    {
+    }
+
+    void Init(QSPIHandle* qspi) {
+        qspi_ = qspi;
+    }
+
+    // Check the cache and point header and paths at its IR, in IR_PATH_*
+    // order, straight in memory-mapped flash. Returns false if there is no
+    // valid cache; the spectra are then read with Read().
+    bool Open(EbirHeader& header, const float** paths) {
+        if (!qspi_) {
+            return false;
+        }
+
+        const uint8_t* base = static_cast<const uint8_t*>(qspi_->GetData(0));
+        IrCacheHeader cache;
+        memcpy(&cache, base, sizeof(cache));
+        if (memcmp(cache.magic, IR_CACHE_MAGIC, sizeof(cache.magic)) != 0 ||
+            cache.version != IR_CACHE_VERSION ||
+            cache.size < sizeof(EbirHeader) || cache.size > IR_CACHE_CAPACITY) {
+            return false;
+        }
+
+        const uint8_t* data = base + IR_CACHE_DATA;
+        memcpy(&header, data, sizeof(header));
+        size_t irBytes = (size_t)header.paths * header.length * sizeof(float);
+        if (memcmp(header.magic, EBIR_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != EBIR_VERSION ||
+            header.paths == 0 || header.paths > 4 ||
+            sizeof(header) + irBytes > cache.size) {
+            return false;
+        }
+
+        IrCacheChecksum checksum;
+        checksum.Add(data + sizeof(header), cache.size - sizeof(header));
+        checksum.Add(&header, sizeof(header));
+        if (checksum.Value() != cache.checksum) {
+            return false;
+        }
+
+        const float* ir = reinterpret_cast<const float*>(data + sizeof(header));
+        for (uint32_t path = 0; path < header.paths; path++) {
+            paths[path] = ir + path * header.length;
+        }
+        readPos_ = IR_CACHE_DATA + sizeof(header) + irBytes;
+        readEnd_ = IR_CACHE_DATA + cache.size;
+        cachedHash_ = header.sourceHash;
+        return true;
+    }
+
+    // EbirReadFn for the spectra after Open(), context being the cache
+    static bool Read(void* context, void* data, size_t bytes) {
+        IrFlashCache* cache = static_cast<IrFlashCache*>(context);
+        if (bytes > cache->readEnd_ - cache->readPos_) {
+            return false;
+        }
+        memcpy(data, cache->qspi_->GetData(cache->readPos_), bytes);
+        cache->readPos_ += bytes;
+        return true;
+    }
+
+    // Source hash of the cached IR (0: none)
+    uint32_t CachedHash() const {
+        return cachedHash_;
+    }
+
+    bool Idle() const {
+        return state_ == CACHE_IDLE;
+    }
+
+    // Start replacing the cache with slot. fullSize is the slot's .ebir
+    // size with spectra and irSize without; the spectra are left out if
+    // they do not fit.
+    void Save(size_t slot, uint32_t sourceHash, size_t fullSize, size_t irSize) {
+        if (!qspi_ || !SaveIRCallback || state_ != CACHE_IDLE || irSize > IR_CACHE_CAPACITY) {
+            return;
+        }
+
+        slot_ = slot;
+        sourceHash_ = sourceHash;
+        spectra_ = fullSize <= IR_CACHE_CAPACITY;
+        size_ = spectra_ ? fullSize : irSize;
+        cachedHash_ = 0; // Invalid from the first erase on
+        pos_ = 0;
+        state_ = CACHE_ERASE;
+    }
+
+    // Abandon a save, leaving no valid cache
+    void Cancel() {
+        state_ = CACHE_IDLE;
+    }
+
+    // Advance a save by one slice: one sector erase, one slice of the IR
+    // stream or the commit
+    void Process() {
+        switch (state_) {
+        case CACHE_IDLE: break;
+        case CACHE_ERASE: Erase(); break;
+        case CACHE_WRITE: Write(); break;
+        case CACHE_COMMIT: Commit(); break;
+        }
+    }
+
+    // Set callback writing slot as an .ebir stream, a slice per call
+    typedef EbirStatus (*SaveIRCallbackFn)(size_t slot, EbirWriteFn write, void* context, uint32_t sourceHash);
+    static SaveIRCallbackFn SaveIRCallback;
+
+private:
+    enum CacheState {
+        CACHE_IDLE,
+        CACHE_ERASE,        // Erase the header sector and the data sectors
+        CACHE_WRITE,        // Program the stream as the reverb produces it
+        CACHE_COMMIT        // Program the EbirHeader and the commit header
+    };
+
+    QSPIHandle* qspi_;
+    CacheState state_;
+    uint32_t cachedHash_;
+
+    size_t slot_;
+    uint32_t sourceHash_;
+    size_t size_;           // Bytes of stream to keep
+    bool spectra_;          // The spectra fit and are kept
+    size_t pos_;            // Bytes erased, then bytes of stream seen
+    EbirHeader header_;     // Held back until the commit
+    IrCacheChecksum checksum_;
+
+    size_t readPos_;        // Read() position, as a flash offset
+    size_t readEnd_;
+
+    void Erase() {
+        if (qspi_->EraseSector(pos_) != QSPIHandle::Result::OK) {
+            state_ = CACHE_IDLE;
+            return;
+        }
+
+        pos_ += IR_CACHE_SECTOR;
+        if (pos_ < IR_CACHE_DATA + size_) {
+            return;
+        }
+        pos_ = 0;
+        checksum_ = IrCacheChecksum();
+        state_ = CACHE_WRITE;
+    }
+
+    void Write() {
+        EbirStatus status = SaveIRCallback(slot_, WriteStream, this, sourceHash_);
+        if (status == EBIR_BUSY) {
+            return;
+        }
+        state_ = (status == EBIR_DONE && pos_ >= size_) ? CACHE_COMMIT : CACHE_IDLE;
+    }
+
+    // EbirWriteFn: keeps the EbirHeader, programs the rest up to size_
+    static bool WriteStream(void* context, const void* data, size_t bytes) {
+        IrFlashCache* cache = static_cast<IrFlashCache*>(context);
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+
+        if (cache->pos_ < sizeof(EbirHeader)) {
+            size_t count = sizeof(EbirHeader) - cache->pos_;
+            if (count > bytes) count = bytes;
+            memcpy(reinterpret_cast<uint8_t*>(&cache->header_) + cache->pos_, p, count);
+            cache->pos_ += count;
+            p += count;
+            bytes -= count;
+        }
+
+        size_t count = (cache->pos_ < cache->size_) ? cache->size_ - cache->pos_ : 0;
+        if (count > bytes) count = bytes;
+        if (count > 0) {
+            if (cache->qspi_->Write(IR_CACHE_DATA + cache->pos_, count, const_cast<uint8_t*>(p)) !=
+                QSPIHandle::Result::OK) {
+                return false;
+            }
+            cache->checksum_.Add(p, count);
+        }
+
+        // Spectra past size_ are dropped when only the IR is kept
+        cache->pos_ += bytes;
+        return true;
+    }
+
+    void Commit() {
+        if (!spectra_) {
+            header_.layoutHash = 0; // Never matches: the IR is transformed on boot
+        }
+
+        checksum_.Add(&header_, sizeof(header_));
+
+        IrCacheHeader cache;
+        memcpy(cache.magic, IR_CACHE_MAGIC, sizeof(cache.magic));
+        cache.version = IR_CACHE_VERSION;
+        cache.size = size_;
+        cache.checksum = checksum_.Value();
+
+        bool ok = qspi_->Write(IR_CACHE_DATA, sizeof(header_), reinterpret_cast<uint8_t*>(&header_)) ==
+                      QSPIHandle::Result::OK &&
+                  qspi_->Write(0, sizeof(cache), reinterpret_cast<uint8_t*>(&cache)) == QSPIHandle::Result::OK;
+        if (ok) {
+            cachedHash_ = sourceHash_;
+        }
+        state_ = CACHE_IDLE;
+    }
+};
+
+// Initialize static members
+IrFlashCache::SaveIRCallbackFn IrFlashCache::SaveIRCallback = nullptr;
@@ -0,0 +1,57 @@
+// Echo Bridge — High-quality convolution reverb for Daisy Seed
+// Copyright (C) 2025  Daniel Ramirez / LUFS Audio
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "daisy_core.h"
+
+// Memory placement for Echo Bridge buffers and hot code.
+//
+// The STM32H750 has three data regions that matter here:
+//   DTCM  (128KB) - zero wait state, uncached, CPU-only; the stack sits at the top
+//   AXI   (512KB) - cached internal SRAM, the default home of .data/.bss
+//   SDRAM (64MB)  - external over FMC; cached but far slower on misses
+//
+// Anything touched on every scheduler tick goes in DTCM or AXI SRAM. Only
+// the bulk IR spectra and input delay lines of the large sections, the
+// time-domain IR copies, the loader buffers and the predelay line live in
+// SDRAM. See doc/TECHNICAL.md for the per-region budget.
+
+// Hot per-tick state: section 0 and the section accumulators
+#define ECHO_DTCM_BSS DTCM_MEM_SECTION
+
+// Warm state too large for DTCM (staging spectra, wet ring, history)
+#define ECHO_AXI_BSS
+
+// Bulk, mostly streaming storage
+#define ECHO_SDRAM_BSS DSY_SDRAM_BSS
+
+// Hot code (FFT passes, MAC, the per-chunk loop). The stock libDaisy linker
+// script has no ITCM output section, but it collects *(.data*) into AXI
+// SRAM and copies it from flash at startup, so the kernels run from RAM
+// without touching the script. Only on the target: host builds keep the
+// code in .text.
+#if defined(__arm__)
+#define ECHO_FAST_CODE __attribute__((section(".data.echo_fast_code")))
+#else
+#define ECHO_FAST_CODE
+#endif
+
+// Let ShyFFT place its kernels with the rest of the hot code
+#ifndef SHY_FFT_FAST_CODE
+#define SHY_FFT_FAST_CODE ECHO_FAST_CODE
+#endif
@@ -0,0 +1,2977 @@
+// Echo Bridge — High-quality convolution reverb for Daisy Seed
+// Copyright (C) 2025  Daniel Ramirez / LUFS Audio
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "daisysp.h"
+#include "daisy_core.h"
+#include "BuildProfile.h"
+#include "DspProfiler.h"
+#include "EbirFile.h"
+#include "IRLoader.h"
+#include "MemoryMap.h"
+#include "shy_fft.h"
+#include "SpectralFreeze.h"
+#include <atomic>
+#include <math.h>
+#include <string.h>
+
+// Partition layout (Gardner-style non-uniform partitioning)
+// Section 0 runs on every scheduler tick; each later section uses larger
+// partitions (4x in the default profile) and starts at twice its partition
+// size into the IR, which gives it a whole partition's worth of ticks to
+// finish a block before its output is due. That lets the scheduler spread
+// the large FFTs and multiply-accumulates evenly across audio blocks
+// instead of running them in one go. The build profile picks the sizes.
+static const size_t PARTITION_SIZE_0 = PROFILE_PARTITION_0;
+static const size_t PARTITION_SIZE_1 = PROFILE_PARTITION_1;
+static const size_t PARTITION_SIZE_2 = PROFILE_PARTITION_2;
+static const size_t PARTITION_SIZE_3 = PROFILE_PARTITION_3;
+
+static const size_t SECTION_OFFSET_0 = 0;
+static const size_t SECTION_OFFSET_1 = 2 * PARTITION_SIZE_1;
+static const size_t SECTION_OFFSET_2 = 2 * PARTITION_SIZE_2;
+static const size_t SECTION_OFFSET_3 = 2 * PARTITION_SIZE_3;
+
+static const size_t SECTION_PARTITIONS_0 = (SECTION_OFFSET_1 - SECTION_OFFSET_0) / PARTITION_SIZE_0;
+static const size_t SECTION_PARTITIONS_1 = (SECTION_OFFSET_2 - SECTION_OFFSET_1) / PARTITION_SIZE_1;
+static const size_t SECTION_PARTITIONS_2 = (SECTION_OFFSET_3 - SECTION_OFFSET_2) / PARTITION_SIZE_2;
+static const size_t SECTION_PARTITIONS_3 =
+    (MAX_IR_LENGTH - SECTION_OFFSET_3 + PARTITION_SIZE_3 - 1) / PARTITION_SIZE_3;
+
+// Scheduler tick: the smallest partition. Larger sections get
+// partition size / tick ticks to complete each block.
+static const size_t SCHEDULER_TICK = PARTITION_SIZE_0;
+
+// Overall latency of the wet path (one section 0 block)
+static const size_t WET_LATENCY = PARTITION_SIZE_0;
+
+// Zero-latency mode: the first FIR_HEAD_LENGTH taps run as a time-domain FIR
+// inside each block and section 0 starts at that tap with no wet latency.
+// Section 0 finishes its block in the tick it completes, so its offset must
+// be at least one partition; keep this a multiple of PARTITION_SIZE_0.
+static const size_t FIR_HEAD_LENGTH = PARTITION_SIZE_0;
+static const size_t FIR_HEAD_PARTITIONS = FIR_HEAD_LENGTH / PARTITION_SIZE_0;
+
+// Multirate tail: optionally the section 3 range of the IR, where a late
+// tail seldom carries much top end, runs on the input decimated by 2 or 4
+// and is interpolated back as it is deposited. Both sides use one
+// linear-phase lowpass at the decimated Nyquist frequency, a Kaiser-
+// windowed sinc of TAIL_FILTER_SPAN taps per side and unit of decimation:
+// a half-band filter at 2x.
+static const size_t MAX_TAIL_DECIMATION = 4;
+static const size_t TAIL_FILTER_SPAN = 12;
+static const size_t MAX_TAIL_FILTER_TAPS = 2 * TAIL_FILTER_SPAN * MAX_TAIL_DECIMATION - 1;
+static const float TAIL_FILTER_BETA = 6.76f; // About 70dB stopband
+
+// Wet output accumulator, indexed by output time. Must be a power of two
+// larger than the furthest a section deposits ahead of the read position
+// (offset + latency of the last section).
+static const size_t WET_RING_SIZE = 16384;
+static const size_t WET_RING_MASK = WET_RING_SIZE - 1;
+
+static const size_t MAX_PREDELAY_SAMPLES = PROFILE_SAMPLE_RATE / 2; // 500ms
+
+// The predelay ring is rounded up to a power of two so its positions wrap
+// with a mask
+static const size_t PREDELAY_RING_SIZE = (MAX_PREDELAY_SAMPLES > 32768) ? 65536 : 32768;
+static const size_t PREDELAY_RING_MASK = PREDELAY_RING_SIZE - 1;
+
+// Parameter smoothing in the audio path. Predelay changes crossfade from
+// the old tap to the new one over PREDELAY_FADE samples; filter cutoffs
+// glide with a one-pole time constant of FILTER_SMOOTHING_SECONDS.
+static const size_t PREDELAY_FADE = SCHEDULER_TICK;
+static const float FILTER_SMOOTHING_SECONDS = 0.02f;
+
+// With filter folding on, the low/high cut is baked into a filtered copy of
+// the playing IR once the cutoffs have held still for FOLD_SETTLE_SECONDS
+static const float FOLD_SETTLE_SECONDS = 0.5f;
+
+// Bypass with spillover: the dry path goes to unity gain and the reverb's
+// input fades out over BYPASS_FADE samples, so the tail rings out
+static const size_t BYPASS_FADE = PROFILE_SAMPLE_RATE / 100; // 10ms
+
+// DSP gate: once the reverb's input and wet output have stayed below
+// GATE_THRESHOLD_DB (peak) for GATE_HOLD_SECONDS, past the predelay, the
+// convolution is paused until the input comes back
+static const float GATE_THRESHOLD_DB = -80.0f;
+static const float GATE_HOLD_SECONDS = 0.5f;
+
+// Partitions quieter than this RMS level (-120dBFS) on every path, such as
+// the silence before a late reflection, are left out of the
+// multiply-accumulate. Slots mark them as their spectra are prepared.
+static const float SILENT_PARTITION_LEVEL = 1e-6f;
+static const size_t SILENT_MASK_BITS = 64;
+
+// IR channel layouts
+enum IrLayout {
+    IR_LAYOUT_MONO,         // One IR shared by both channels
+    IR_LAYOUT_STEREO,       // L -> L and R -> R
+    IR_LAYOUT_TRUE_STEREO   // Full 2x2 matrix: LL, LR, RL and RR
+};
+
+// IR paths, named input then output (LR = left input to right output).
+// Path 1 is also the right IR of a plain stereo pair.
+static const size_t IR_PATH_LL = 0;
+static const size_t IR_PATH_RR = 1;
+static const size_t IR_PATH_LR = 2;
+static const size_t IR_PATH_RL = 3;
+static const size_t IR_PATHS = 4;
+
+// Fade-out applied across the last partition of a shortened IR: gain of
+// sample i of n, falling from just below 1 to just above 0
+inline float IrTaperGain(size_t i, size_t n) {
+    return 0.5f + 0.5f * cosf(3.14159265f * (i + 0.5f) / n);
+}
+
+// Shortened IRs end on a partition boundary of the section the cut falls
+// in, so a length change drops whole partitions and only the tapered last
+// one needs a transform. Returns the IR length actually used for length.
+inline size_t IrLengthCut(size_t length) {
+    size_t unit = PARTITION_SIZE_3;
+    if (length <= SECTION_OFFSET_1) {
+        unit = PARTITION_SIZE_0;
+    } else if (length <= SECTION_OFFSET_2) {
+        unit = PARTITION_SIZE_1;
+    } else if (length <= SECTION_OFFSET_3) {
+        unit = PARTITION_SIZE_2;
+    }
+    return (length + unit - 1) / unit * unit;
+}
+
+// IR spectra are double-buffered: the main loop prepares the idle bank while
+// the audio path reads the live one, then the two swap at a tick boundary
+static const size_t IR_BANKS = 2;
+
+// Wet output streams: WET_FILTERED still goes through the low/high cut
+// filters, WET_FOLDED comes from a bank with the filters folded into its
+// spectra. A crossfade between the two kinds of bank fades each out or in
+// on its own stream.
+static const size_t WET_FILTERED = 0;
+static const size_t WET_FOLDED = 1;
+static const size_t WET_STREAMS = 2;
+
+// Uniformly partitioned overlap-save convolver.
+// Every completed input block is transformed once and stored in a
+// frequency-domain delay line (FDL). The output block is the inverse
+// transform of the multiply-accumulate of the FDL against one IR spectrum
+// per partition, so the cost grows with IR length instead of being capped.
+//
+// The work for a block is a job made of roughly equal units (one FFT pass,
+// one partition multiply-accumulate, ...). StartJob() is called when the
+// block completes and RunTick() once per scheduler tick; each tick runs its
+// share of the units so the job is done after jobTicks ticks.
+//
+// The topology is picked per job. A mono input is transformed once and its
+// FDL slot is flagged mono, so the right channel reads the left spectrum.
+// While the IR is mono and no stereo spectrum is left in the FDL, both
+// outputs are identical and a single MAC and inverse FFT feeds both rings.
+// A true-stereo IR accumulates two IR spectra per output channel (one per
+// input spectrum) before the single inverse FFT of that channel.
+//
+// A bank is the view of one prepared IR the jobs read: AttachBank() either
+// copies its spectra into local bank storage (small sections that must stay
+// in fast memory) or just points the bank at them. A shortened IR's tapered
+// last partition lives in separate per-bank storage, so the prepared
+// spectra are never modified. SelectBank() switches the jobs that start
+// afterwards to another of the IR_BANKS banks; the first such job renders
+// its block with both banks and crossfades from the old output to the new
+// one. Each bank deposits into one of the WET_STREAMS pairs of wet rings.
+//
+// Partitions a bank marks silent are skipped: a job only has units for the
+// partitions in the bank's MAC list.
+//
+// A section fed a decimated input (see SetRate()) still deposits into the
+// full-rate wet rings: every output sample is scattered through the
+// interpolation filter, so overlapping blocks add up to the interpolated
+// stream without any state carried between them.
+template <size_t B>
+class ConvolutionSection {
+public:
+    static const size_t FFT_SIZE = B * 2;
+    // Real-input FFT: one spectrum is BINS real values followed by BINS
+    // imaginary values, with the Nyquist bin packed into the imaginary DC slot
+    static const size_t BINS = ShyFFT<float, FFT_SIZE>::BINS;
+    static const size_t SPECTRUM_SIZE = BINS * 2;
+    static const size_t FFT_PASSES = ShyFFT<float, FFT_SIZE>::Passes();
+
+    // Largest FDL supported by the per-slot mono flags and the MAC lists
+    static const size_t MAX_SLOTS = 256;
+
+    // Marks no partition
+    static const size_t NO_PARTITION = ~static_cast<size_t>(0);
+
+    // Storage sizes in floats for the buffers handed to Init(). Local bank
+    // storage is optional.
+    static constexpr size_t IrStorageSize(size_t partitions) { return IR_BANKS * IR_PATHS * partitions * SPECTRUM_SIZE; }
+    static constexpr size_t TaperStorageSize() { return IR_BANKS * IR_PATHS * SPECTRUM_SIZE; }
+    static constexpr size_t FdlStorageSize(size_t partitions) { return 2 * partitions * SPECTRUM_SIZE; }
+    // Input history window plus the staging spectrum for both channels
+    static constexpr size_t InputStorageSize() { return 2 * FFT_SIZE + 2 * SPECTRUM_SIZE; }
+
+    ConvolutionSection() :
+        irSpectra_(nullptr),
+        taper_(nullptr),
+        fdl_(nullptr),
+        history_{nullptr, nullptr},
+        staging_{nullptr, nullptr},
+        acc_(nullptr),
+        wet_{{nullptr, nullptr}, {nullptr, nullptr}},
+        offset_(0),
+        maxPartitions_(0),
+        fdlHead_(0),
+        bankSpectra_{nullptr, nullptr},
+        bankStride_{0, 0},
+        prepared_{0, 0},
+        partitions_{0, 0},
+        macCount_{0, 0},
+        macPartitions_{0, 0},
+        tapered_{NO_PARTITION, NO_PARTITION},
+        layout_{IR_LAYOUT_MONO, IR_LAYOUT_MONO},
+        stream_{WET_FILTERED, WET_FILTERED},
+        bank_(0),
+        fadePending_(false),
+        stereoSlots_(0),
+        inputPos_(0),
+        jobTicks_(1),
+        jobActive_(false),
+        jobUnits_(0),
+        jobDone_(0),
+        jobTick_(0),
+        jobSlot_(0),
+        jobRingPos_(0),
+        jobFade_(false),
+        jobEntries_(0),
+        jobBank_{0, 0},
+        jobPartitions_{0, 0},
+        jobTapered_{NO_PARTITION, NO_PARTITION},
+        jobLayout_{IR_LAYOUT_MONO, IR_LAYOUT_MONO},
+        jobStream_{WET_FILTERED, WET_FILTERED},
+        jobTerms_{1, 1},
+        jobChannelUnits_(0),
+        jobInputs_(0),
+        jobOutputs_(0),
+        rate_(1),
+        upGain_(nullptr),
+        upOffset_(nullptr),
+        upTaps_(0),
+        upDelay_(0),
+        depositUnits_(1)
+    {
+    }
+
+    // Attach storage. offset is the first IR sample this section covers and
+    // jobTicks the number of scheduler ticks a block's work may be spread over.
+    // The newest input spectrum is transformed in the input storage and only
+    // then copied into the FDL, so the FFT passes never run against the bulk
+    // (possibly SDRAM) storage. acc holds SPECTRUM_SIZE floats; the inverse
+    // transform runs in place there. With irSpectra set, banks copy the IR
+    // spectra in; without it they read them where they were prepared.
+    void Init(size_t offset, size_t maxPartitions, size_t jobTicks,
+              float* irSpectra, float* taper, float* fdl, float* input, float* acc) {
+        offset_ = offset;
+        maxPartitions_ = (maxPartitions < MAX_SLOTS) ? maxPartitions : MAX_SLOTS;
+        jobTicks_ = (jobTicks > 0) ? jobTicks : 1;
+        irSpectra_ = irSpectra;
+        taper_ = taper;
+        fdl_ = fdl;
+        history_[0] = input;
+        history_[1] = input + FFT_SIZE;
+        staging_[0] = input + 2 * FFT_SIZE;
+        staging_[1] = staging_[0] + SPECTRUM_SIZE;
+        acc_ = acc;
+
+        for (size_t bank = 0; bank < IR_BANKS; bank++) {
+            bankSpectra_[bank] = irSpectra_ ? irSpectra_ + bank * IR_PATHS * maxPartitions_ * SPECTRUM_SIZE : nullptr;
+            bankStride_[bank] = maxPartitions_;
+            prepared_[bank] = 0;
+            partitions_[bank] = 0;
+            macCount_[bank] = 0;
+            macPartitions_[bank] = 0;
+            tapered_[bank] = NO_PARTITION;
+            layout_[bank] = IR_LAYOUT_MONO;
+            stream_[bank] = WET_FILTERED;
+        }
+        bank_ = 0;
+        fadePending_ = false;
+
+        rate_ = 1;
+        upTaps_ = 0;
+        upDelay_ = 0;
+        depositUnits_ = 1;
+
+        Reset();
+    }
+
+    // Run on an input decimated by factor, after Init(). The output is
+    // scattered into the wet rings through the taps nonzero taps of the
+    // interpolation filter (gain, which includes the factor, and offset of
+    // each), brought forward by delay full-rate samples to make up for the
+    // decimation filter and the centre of the interpolation filter.
+    void SetRate(size_t factor, const float* gain, const size_t* offset, size_t taps, size_t delay) {
+        rate_ = factor;
+        upGain_ = gain;
+        upOffset_ = offset;
+        upTaps_ = taps;
+        upDelay_ = delay;
+        depositUnits_ = (taps + 3) / 4;
+    }
+
+    // Clear the input history and the FDL
+    void Reset() {
+        memset(history_[0], 0, FFT_SIZE * sizeof(float));
+        memset(history_[1], 0, FFT_SIZE * sizeof(float));
+        memset(fdl_, 0, FdlStorageSize(maxPartitions_) * sizeof(float));
+
+        // Silent slots are identical on both channels
+        for (size_t slot = 0; slot < maxPartitions_; slot++) {
+            slotMono_[slot] = true;
+        }
+        stereoSlots_ = 0;
+
+        fdlHead_ = 0;
+        inputPos_ = 0;
+        jobActive_ = false;
+    }
+
+    // Prepared IR spectra (see IrSlot) are laid out path by path, stride
+    // partitions per path, each SPECTRUM_SIZE floats
+    static float* PreparedSpectrum(float* spectra, size_t stride, size_t path, size_t p) {
+        return spectra + (path * stride + p) * SPECTRUM_SIZE;
+    }
+
+    // Transform IR partition p of one path into prepared spectra that no
+    // bank is attached to yet. path is one of the IR_PATH_* values. scratch
+    // holds FFT_SIZE floats for the zero-padded partition.
+    void SetIRPartition(float* spectra, size_t stride, size_t path, const float* ir, size_t length,
+                        size_t p, float* scratch) {
+        TransformBlock(ir, length, offset_ + p * B, false, scratch, PreparedSpectrum(spectra, stride, path, p));
+    }
+
+    // True if a prepared spectrum is below SILENT_PARTITION_LEVEL. The
+    // forward transform is unscaled, so its bins hold B times the energy of
+    // the partition's samples.
+    static bool SilentSpectrum(const float* spectrum) {
+        float energy = 0.0f;
+        for (size_t i = 0; i < SPECTRUM_SIZE; i++) {
+            energy += spectrum[i] * spectrum[i];
+        }
+        return energy < SILENT_PARTITION_LEVEL * SILENT_PARTITION_LEVEL * B * B;
+    }
+
+    // Attach bank, which must not be in use by the audio path, to the
+    // prepared spectra of an IR of length samples. Bit p of silent marks
+    // partition p silent on every path; all other partitions take part
+    // until SetLength() shortens the bank.
+    void AttachBank(size_t bank, float* spectra, size_t stride, size_t length, size_t paths, uint64_t silent) {
+        size_t partitions = PartitionsFor(length);
+        if (irSpectra_) {
+            for (size_t path = 0; path < paths; path++) {
+                memcpy(IrReal(bank, path, 0), PreparedSpectrum(spectra, stride, path, 0),
+                       partitions * SPECTRUM_SIZE * sizeof(float));
+            }
+        } else {
+            bankSpectra_[bank] = spectra;
+            bankStride_[bank] = stride;
+        }
+
+        size_t count = 0;
+        for (size_t p = 0; p < partitions; p++) {
+            if (p >= SILENT_MASK_BITS || !((silent >> p) & 1)) {
+                macList_[bank][count++] = static_cast<uint8_t>(p);
+            }
+        }
+        macCount_[bank] = count;
+
+        prepared_[bank] = partitions;
+        partitions_[bank] = partitions;
+        macPartitions_[bank] = count;
+        tapered_[bank] = NO_PARTITION;
+    }
+
+    // Use only the IR up to cut (from IrLengthCut) in bank. Partitions past
+    // the cut are dropped from the multiply-accumulate; with taper set the
+    // partition ending at the cut is faded out, using a tapered copy of its
+    // spectrum in the bank's taper storage - one partition transform per
+    // path. ir holds the time-domain IR per path.
+    void SetLength(size_t bank, size_t cut, bool taper, size_t paths,
+                   const float* const* ir, size_t length, float* scratch) {
+        size_t partitions = 0;
+        if (cut > offset_) {
+            partitions = (cut - offset_ + B - 1) / B;
+            if (partitions > prepared_[bank]) partitions = prepared_[bank];
+        }
+
+        // Only the section the cut falls in has a tapered partition
+        size_t tapered = NO_PARTITION;
+        if (taper && partitions > 0 && offset_ + partitions * B == cut) {
+            tapered = partitions - 1;
+        }
+
+        if (tapered != tapered_[bank] && tapered != NO_PARTITION) {
+            for (size_t path = 0; path < paths; path++) {
+                TransformBlock(ir[path], length, offset_ + tapered * B, true, scratch, TaperReal(bank, path));
+            }
+        }
+        tapered_[bank] = tapered;
+        partitions_[bank] = partitions;
+
+        size_t macs = 0;
+        while (macs < macCount_[bank] && macList_[bank][macs] < partitions) {
+            macs++;
+        }
+        macPartitions_[bank] = macs;
+    }
+
+    // Partitions this section needs for an IR of length samples
+    size_t PartitionsFor(size_t length) const {
+        size_t partitions = 0;
+        if (length > offset_) {
+            partitions = (length - offset_ + B - 1) / B;
+            if (partitions > maxPartitions_) partitions = maxPartitions_;
+        }
+        return partitions;
+    }
+
+    // Prepared spectrum of an IR of length samples for the partition
+    // starting at IR sample start, or nullptr if this section does not hold
+    // that partition. Used to read precomputed spectra straight in.
+    float* PartitionSpectrum(float* spectra, size_t stride, size_t path, size_t length, size_t start) {
+        size_t p = PartitionAt(length, start);
+        return (p != NO_PARTITION) ? PreparedSpectrum(spectra, stride, path, p) : nullptr;
+    }
+
+    // Partition of an IR of length samples starting at IR sample start, or
+    // NO_PARTITION if this section does not hold it
+    size_t PartitionAt(size_t length, size_t start) const {
+        if (start < offset_ || (start - offset_) % B != 0) {
+            return NO_PARTITION;
+        }
+        size_t p = (start - offset_) / B;
+        return (p < PartitionsFor(length)) ? p : NO_PARTITION;
+    }
+
+    // Spectrum of the partition starting at IR sample start, taken from the
+    // prepared spectra when this section holds it and otherwise transformed
+    // into out (SPECTRUM_SIZE floats)
+    const float* PlainSpectrum(float* spectra, size_t stride, size_t path, const float* ir, size_t length,
+                               size_t start, float* scratch, float* out) {
+        const float* spectrum = PartitionSpectrum(spectra, stride, path, length, start);
+        if (spectrum) {
+            return spectrum;
+        }
+        TransformBlock(ir, length, start, false, scratch, out);
+        return out;
+    }
+
+    size_t ActivePartitions() const {
+        return partitions_[bank_];
+    }
+
+    // Use bank (holding IRs of the given layout, depositing into wet
+    // stream) for the jobs started from now on. With crossfade set the next
+    // job fades from the previous bank to this one over its block; the
+    // previous bank stays in use until Fading() returns false.
+    void SelectBank(size_t bank, IrLayout layout, size_t stream, bool crossfade) {
+        layout_[bank] = layout;
+        stream_[bank] = stream;
+        fadePending_ = crossfade && bank != bank_;
+        bank_ = bank;
+    }
+
+    bool Fading() const {
+        return fadePending_ || (jobActive_ && jobFade_);
+    }
+
+    // Append n input samples (never past the end of the current block);
+    // returns true when a full block is waiting
+    bool Write(const float* left, const float* right, size_t n) {
+        memcpy(history_[0] + B + inputPos_, left, n * sizeof(float));
+        memcpy(history_[1] + B + inputPos_, right, n * sizeof(float));
+        inputPos_ += n;
+        return inputPos_ >= B;
+    }
+
+    // Start the job for the block that just completed. Its B output samples
+    // are added into the wet rings starting at ringPos. With monoInput set
+    // only the left input is transformed.
+    void StartJob(size_t ringPos, bool monoInput) {
+        // A job must never outlive its block; finish any leftover work first
+        while (jobActive_) {
+            RunUnit();
+        }
+
+        inputPos_ = 0;
+
+        // Pack the input window (previous + current block) bit-reversed into
+        // the staging spectrum; the forward passes then run in place there
+        jobInputs_ = monoInput ? 1 : 2;
+        for (size_t ch = 0; ch < 2; ch++) {
+            if (ch < jobInputs_) {
+                float* re = staging_[ch];
+                fft_.PackPermute(history_[ch], re, re + BINS);
+            }
+
+            // Slide the window for the next block (both channels, so a later
+            // switch to stereo starts from valid history)
+            memcpy(history_[ch], history_[ch] + B, B * sizeof(float));
+        }
+
+        if (slotMono_[fdlHead_] != monoInput) {
+            slotMono_[fdlHead_] = monoInput;
+            stereoSlots_ = monoInput ? stereoSlots_ - 1 : stereoSlots_ + 1;
+        }
+
+        jobSlot_ = fdlHead_;
+        jobRingPos_ = ringPos;
+
+        // One entry per IR bank taking part: the previous bank first when
+        // this job crossfades, then the current one
+        jobFade_ = fadePending_;
+        fadePending_ = false;
+        jobEntries_ = 0;
+        if (jobFade_) {
+            AddJobEntry(bank_ ^ 1);
+        }
+        AddJobEntry(bank_);
+
+        bool anyPartitions = false;
+        bool stereoOutput = stereoSlots_ > 0;
+        jobChannelUnits_ = 0;
+        for (size_t entry = 0; entry < jobEntries_; entry++) {
+            anyPartitions = anyPartitions || jobPartitions_[entry] > 0;
+            stereoOutput = stereoOutput || jobLayout_[entry] != IR_LAYOUT_MONO;
+            jobChannelUnits_ += OutputUnits(entry);
+        }
+        jobOutputs_ = !anyPartitions ? 0 : stereoOutput ? 2 : 1;
+        jobUnits_ = jobInputs_ * InputUnits() + jobOutputs_ * jobChannelUnits_;
+        jobDone_ = 0;
+        jobTick_ = 0;
+        jobActive_ = true;
+
+        fdlHead_ = (fdlHead_ + 1 == maxPartitions_) ? 0 : fdlHead_ + 1;
+    }
+
+    // Run this tick's share of the current job. wet holds the left and
+    // right ring of each wet stream.
+    void RunTick(float* const (*wet)[2]) {
+        if (!jobActive_) {
+            return;
+        }
+
+        for (size_t stream = 0; stream < WET_STREAMS; stream++) {
+            wet_[stream][0] = wet[stream][0];
+            wet_[stream][1] = wet[stream][1];
+        }
+
+        jobTick_++;
+        size_t target = (jobUnits_ * jobTick_ + jobTicks_ - 1) / jobTicks_;
+        while (jobActive_ && jobDone_ < target) {
+            RunUnit();
+        }
+    }
+
+    // Distance from the current wet read position to the first output sample
+    // of a block completed now, for a wet path with the given latency. At a
+    // decimated rate that is the position of the first interpolation tap.
+    size_t DepositOffset(size_t latency) const {
+        return (offset_ - B) * rate_ + latency - upDelay_;
+    }
+
+private:
+    ShyFFT<float, FFT_SIZE> fft_;
+
+    float* irSpectra_;
+    float* taper_;
+    float* fdl_;
+    float* history_[2];
+    float* staging_[2];
+    float* acc_;
+    float* wet_[WET_STREAMS][2];
+
+    size_t offset_;
+    size_t maxPartitions_;
+    size_t fdlHead_;
+
+    // IR banks: the spectra read and their stride, partitions attached,
+    // partitions in use, the tapered last partition, the layout and the wet
+    // stream of each, the bank new jobs use and whether the next job
+    // crossfades into it. The MAC list holds the attached partitions that
+    // are not silent, in order; the first macPartitions_ of them are in use.
+    float* bankSpectra_[IR_BANKS];
+    size_t bankStride_[IR_BANKS];
+    size_t prepared_[IR_BANKS];
+    size_t partitions_[IR_BANKS];
+    uint8_t macList_[IR_BANKS][MAX_SLOTS];
+    size_t macCount_[IR_BANKS];
+    size_t macPartitions_[IR_BANKS];
+    size_t tapered_[IR_BANKS];
+    IrLayout layout_[IR_BANKS];
+    size_t stream_[IR_BANKS];
+    size_t bank_;
+    bool fadePending_;
+
+    // Per FDL slot: true when the right input spectrum equals the left one
+    // and was not stored
+    bool slotMono_[MAX_SLOTS];
+    size_t stereoSlots_;
+    size_t inputPos_;
+
+    // Job state
+    size_t jobTicks_;
+    bool jobActive_;
+    size_t jobUnits_;
+    size_t jobDone_;
+    size_t jobTick_;
+    size_t jobSlot_;
+    size_t jobRingPos_;
+    bool jobFade_;
+    size_t jobEntries_;
+    size_t jobBank_[IR_BANKS];
+    size_t jobPartitions_[IR_BANKS];
+    size_t jobTapered_[IR_BANKS];
+    IrLayout jobLayout_[IR_BANKS];
+    size_t jobStream_[IR_BANKS];
+    size_t jobTerms_[IR_BANKS];
+    size_t jobChannelUnits_;
+    size_t jobInputs_;
+    size_t jobOutputs_;
+
+    // Decimated rate (SetRate()): the factor, the interpolation taps and
+    // the units a deposit is split into
+    size_t rate_;
+    const float* upGain_;
+    const size_t* upOffset_;
+    size_t upTaps_;
+    size_t upDelay_;
+    size_t depositUnits_;
+
+    void AddJobEntry(size_t bank) {
+        size_t entry = jobEntries_++;
+        jobBank_[entry] = bank;
+        jobPartitions_[entry] = macPartitions_[bank];
+        jobTapered_[entry] = tapered_[bank];
+        jobLayout_[entry] = layout_[bank];
+        jobStream_[entry] = stream_[bank];
+        jobTerms_[entry] = (layout_[bank] == IR_LAYOUT_TRUE_STEREO) ? 2 : 1;
+    }
+
+    // Per input channel: the forward passes and the spectrum split, which
+    // also moves the finished spectrum into the FDL
+    static constexpr size_t InputUnits() {
+        return FFT_PASSES + 1;
+    }
+
+    // Per output channel and job entry: one unit per partition in use that
+    // is not silent and IR term, the spectrum merge, the in-place permute,
+    // the inverse passes and the deposit, which takes several units when it
+    // interpolates. An entry without such partitions renders nothing.
+    size_t OutputUnits(size_t entry) const {
+        return (jobPartitions_[entry] == 0) ? 0 : MacUnits(entry) + FFT_PASSES + 2 + depositUnits_;
+    }
+
+    size_t MacUnits(size_t entry) const {
+        return jobPartitions_[entry] * jobTerms_[entry];
+    }
+
+    // Execute unit jobDone_ of the current job. Units run in order:
+    // forward transform per input channel, then per output channel and job
+    // entry the MAC, inverse transform and deposit.
+    ECHO_FAST_CODE void RunUnit() {
+        size_t unit = jobDone_++;
+
+        if (unit < jobInputs_ * InputUnits()) {
+            size_t ch = unit / InputUnits();
+            size_t step = unit % InputUnits();
+            float* re = staging_[ch];
+
+            if (step < FFT_PASSES) {
+                fft_.Pass(re, re + BINS, step);
+            } else {
+                fft_.SplitSpectrum(re, re + BINS);
+                memcpy(FdlReal(ch, jobSlot_), re, SPECTRUM_SIZE * sizeof(float));
+            }
+        } else {
+            unit -= jobInputs_ * InputUnits();
+            size_t ch = unit / jobChannelUnits_;
+            size_t step = unit % jobChannelUnits_;
+
+            size_t entry = 0;
+            while (step >= OutputUnits(entry)) {
+                step -= OutputUnits(entry);
+                entry++;
+            }
+
+            size_t macs = MacUnits(entry);
+            size_t terms = jobTerms_[entry];
+
+            if (step < macs) {
+                AccumulatePartition(entry, ch, step / terms, step % terms);
+            } else if (step == macs) {
+                fft_.MergeSpectrum(acc_, acc_ + BINS);
+            } else if (step == macs + 1) {
+                fft_.PermuteInPlace(acc_, acc_ + BINS);
+            } else if (step <= macs + 1 + FFT_PASSES) {
+                fft_.Pass(acc_, acc_ + BINS, step - macs - 2);
+            } else if (rate_ == 1) {
+                Deposit(entry, ch);
+            } else {
+                DepositInterpolated(entry, ch, step - macs - 2 - FFT_PASSES);
+            }
+        }
+
+        if (jobDone_ >= jobUnits_) {
+            jobActive_ = false;
+        }
+    }
+
+    // Multiply-accumulate MAC list entry index of one IR term of output
+    // channel ch against the matching delayed input spectrum, using the bank
+    // of the given job entry. A true-stereo output has two terms: the left
+    // input through LL/LR and the right input through RL/RR.
+    ECHO_FAST_CODE void AccumulatePartition(size_t entry, size_t ch, size_t index, size_t term) {
+        if (index == 0 && term == 0) {
+            memset(acc_, 0, SPECTRUM_SIZE * sizeof(float));
+        }
+        size_t p = macList_[jobBank_[entry]][index];
+
+        IrLayout layout = jobLayout_[entry];
+        size_t input = ch;
+        size_t path = IR_PATH_LL;
+        if (layout == IR_LAYOUT_STEREO) {
+            path = (ch == 0) ? IR_PATH_LL : IR_PATH_RR;
+        } else if (layout == IR_LAYOUT_TRUE_STEREO) {
+            input = term;
+            if (term == 0) {
+                path = (ch == 0) ? IR_PATH_LL : IR_PATH_LR;
+            } else {
+                path = (ch == 0) ? IR_PATH_RL : IR_PATH_RR;
+            }
+        }
+
+        size_t slot = (jobSlot_ + maxPartitions_ - p) % maxPartitions_;
+        size_t inputCh = slotMono_[slot] ? 0 : input;
+
+        const float* xr = FdlReal(inputCh, slot);
+        const float* xi = xr + BINS;
+        const float* hr = (p == jobTapered_[entry]) ? TaperReal(jobBank_[entry], path)
+                                                    : IrReal(jobBank_[entry], path, p);
+        const float* hi = hr + BINS;
+        float* ar = acc_;
+        float* ai = acc_ + BINS;
+
+        // DC and Nyquist are both real and multiply separately
+        ar[0] += xr[0] * hr[0];
+        ai[0] += xi[0] * hi[0];
+
+        for (size_t i = 1; i < BINS; i++) {
+            ar[i] += xr[i] * hr[i] - xi[i] * hi[i];
+            ai[i] += xr[i] * hi[i] + xi[i] * hr[i];
+        }
+    }
+
+    // Add the valid (second) half of the inverse transform into the wet
+    // rings of the entry's stream. Output sample 2k is the accumulator's
+    // real[k] and 2k+1 the negated imag[k]. A single shared output feeds
+    // both rings. In a crossfading job the first entry ramps linearly out
+    // over the block and the second one in.
+    ECHO_FAST_CODE void Deposit(size_t entry, size_t ch) {
+        const float scale = 1.0f / FFT_SIZE;
+        const float* re = acc_ + BINS / 2;
+        const float* im = acc_ + BINS + BINS / 2;
+
+        // Gain of output sample i is gain + slope * i
+        float gain = scale;
+        float slope = 0.0f;
+        if (jobFade_) {
+            float step = scale / B;
+            gain = (entry == 0) ? scale - step : step;
+            slope = (entry == 0) ? -step : step;
+        }
+
+        float* wetL = wet_[jobStream_[entry]][0];
+        float* wetR = wet_[jobStream_[entry]][1];
+        if (jobOutputs_ == 1) {
+            for (size_t k = 0; k < B / 2; k++) {
+                size_t pos = jobRingPos_ + 2 * k;
+                float even = re[k] * gain;
+                float odd = -im[k] * (gain + slope);
+                wetL[pos & WET_RING_MASK] += even;
+                wetL[(pos + 1) & WET_RING_MASK] += odd;
+                wetR[pos & WET_RING_MASK] += even;
+                wetR[(pos + 1) & WET_RING_MASK] += odd;
+                gain += 2.0f * slope;
+            }
+            return;
+        }
+
+        float* wet = (ch == 0) ? wetL : wetR;
+        for (size_t k = 0; k < B / 2; k++) {
+            size_t pos = jobRingPos_ + 2 * k;
+            wet[pos & WET_RING_MASK] += re[k] * gain;
+            wet[(pos + 1) & WET_RING_MASK] -= im[k] * (gain + slope);
+            gain += 2.0f * slope;
+        }
+    }
+
+    // Deposit() at a decimated rate: scatter unit's share of the output
+    // samples through the interpolation filter. Output sample i lands at
+    // rate_ * i from the block's first tap position.
+    ECHO_FAST_CODE void DepositInterpolated(size_t entry, size_t ch, size_t unit) {
+        const float scale = 1.0f / FFT_SIZE;
+        const float* re = acc_ + BINS / 2;
+        const float* im = acc_ + BINS + BINS / 2;
+
+        float gain = scale;
+        float slope = 0.0f;
+        if (jobFade_) {
+            float step = scale / B;
+            gain = (entry == 0) ? scale - step : step;
+            slope = (entry == 0) ? -step : step;
+        }
+
+        float* wetL = wet_[jobStream_[entry]][0];
+        float* wetR = wet_[jobStream_[entry]][1];
+        float* wet = (ch == 0) ? wetL : wetR;
+        size_t begin = B / 2 * unit / depositUnits_;
+        size_t end = B / 2 * (unit + 1) / depositUnits_;
+        for (size_t k = begin; k < end; k++) {
+            size_t pos = jobRingPos_ + 2 * k * rate_;
+            float even = re[k] * (gain + slope * (2 * k));
+            float odd = -im[k] * (gain + slope * (2 * k + 1));
+            if (jobOutputs_ == 1) {
+                Scatter(wetL, pos, even);
+                Scatter(wetL, pos + rate_, odd);
+                Scatter(wetR, pos, even);
+                Scatter(wetR, pos + rate_, odd);
+            } else {
+                Scatter(wet, pos, even);
+                Scatter(wet, pos + rate_, odd);
+            }
+        }
+    }
+
+    // Add value through the interpolation taps into wet from pos on
+    ECHO_FAST_CODE void Scatter(float* wet, size_t pos, float value) {
+        for (size_t t = 0; t < upTaps_; t++) {
+            wet[(pos + upOffset_[t]) & WET_RING_MASK] += value * upGain_[t];
+        }
+    }
+
+    // Transform the B IR samples from start into the spectrum at re
+    void TransformBlock(const float* ir, size_t length, size_t start, bool taper,
+                        float* scratch, float* re) {
+        size_t count = (length - start < B) ? length - start : B;
+
+        // Partition zero-padded to the FFT size
+        memset(scratch, 0, FFT_SIZE * sizeof(float));
+        memcpy(scratch, ir + start, count * sizeof(float));
+        if (taper) {
+            for (size_t i = 0; i < count; i++) {
+                scratch[i] *= IrTaperGain(i, B);
+            }
+        }
+        fft_.Direct(scratch, re, re + BINS);
+    }
+
+    float* IrReal(size_t bank, size_t path, size_t partition) {
+        return bankSpectra_[bank] + (path * bankStride_[bank] + partition) * SPECTRUM_SIZE;
+    }
+
+    float* TaperReal(size_t bank, size_t path) {
+        return taper_ + (bank * IR_PATHS + path) * SPECTRUM_SIZE;
+    }
+
+    float* FdlReal(size_t ch, size_t slot) {
+        return fdl_ + (ch * maxPartitions_ + slot) * SPECTRUM_SIZE;
+    }
+};
+
+// Section storage, placed per MemoryMap.h. Section 0 and the accumulators
+// are touched on every tick and go in DTCM; the staging spectra, input
+// history and wet ring go in AXI SRAM; the FDLs of the larger sections stay
+// in SDRAM. Sections 0 and 1 keep local copies of the bank spectra; the
+// larger sections read theirs straight from the IR slot arena.
+ECHO_DTCM_BSS float g_irSpectra0[ConvolutionSection<PARTITION_SIZE_0>::IrStorageSize(SECTION_PARTITIONS_0)];
+ECHO_DTCM_BSS float g_fdl0[ConvolutionSection<PARTITION_SIZE_0>::FdlStorageSize(SECTION_PARTITIONS_0)];
+ECHO_DTCM_BSS float g_input0[ConvolutionSection<PARTITION_SIZE_0>::InputStorageSize()];
+
+// Scratch arena for the section accumulators. Every section's pending job
+// keeps its accumulator across ticks, so each section gets its own slice;
+// the inverse FFT runs in place in it.
+static const size_t SCRATCH_ARENA_SIZE =
+    ConvolutionSection<PARTITION_SIZE_0>::SPECTRUM_SIZE +
+    ConvolutionSection<PARTITION_SIZE_1>::SPECTRUM_SIZE +
+    ConvolutionSection<PARTITION_SIZE_2>::SPECTRUM_SIZE +
+    ConvolutionSection<PARTITION_SIZE_3>::SPECTRUM_SIZE;
+ECHO_DTCM_BSS alignas(32) float g_scratchArena[SCRATCH_ARENA_SIZE];
+
+// Section 1 is small enough to keep entirely in AXI SRAM
+ECHO_AXI_BSS float g_irSpectra1[ConvolutionSection<PARTITION_SIZE_1>::IrStorageSize(SECTION_PARTITIONS_1)];
+ECHO_AXI_BSS float g_taper0[ConvolutionSection<PARTITION_SIZE_0>::TaperStorageSize()];
+ECHO_AXI_BSS float g_taper1[ConvolutionSection<PARTITION_SIZE_1>::TaperStorageSize()];
+ECHO_AXI_BSS float g_fdl1[ConvolutionSection<PARTITION_SIZE_1>::FdlStorageSize(SECTION_PARTITIONS_1)];
+ECHO_AXI_BSS float g_input1[ConvolutionSection<PARTITION_SIZE_1>::InputStorageSize()];
+
+ECHO_SDRAM_BSS float g_taper2[ConvolutionSection<PARTITION_SIZE_2>::TaperStorageSize()];
+ECHO_SDRAM_BSS float g_fdl2[ConvolutionSection<PARTITION_SIZE_2>::FdlStorageSize(SECTION_PARTITIONS_2)];
+ECHO_AXI_BSS float g_input2[ConvolutionSection<PARTITION_SIZE_2>::InputStorageSize()];
+
+ECHO_SDRAM_BSS float g_taper3[ConvolutionSection<PARTITION_SIZE_3>::TaperStorageSize()];
+ECHO_SDRAM_BSS float g_fdl3[ConvolutionSection<PARTITION_SIZE_3>::FdlStorageSize(SECTION_PARTITIONS_3)];
+ECHO_AXI_BSS float g_input3[ConvolutionSection<PARTITION_SIZE_3>::InputStorageSize()];
+
+// With a multirate tail section 3 is idle and the decimated tail section,
+// half or a quarter its size, runs in its storage and accumulator
+
+// Wet output accumulator - read and cleared every sample
+ECHO_AXI_BSS float g_wetRing[WET_RING_SIZE];
+ECHO_AXI_BSS float g_wetRingRight[WET_RING_SIZE];
+
+// Wet accumulator of banks with the filters folded in (WET_FOLDED); only
+// read while such a bank plays or drains
+ECHO_SDRAM_BSS float g_wetRingFolded[WET_RING_SIZE];
+ECHO_SDRAM_BSS float g_wetRingFoldedRight[WET_RING_SIZE];
+
+// Zero-padded partition scratch for IR preparation, shared by all sections,
+// followed by room for one spectrum when exporting precomputed spectra
+ECHO_SDRAM_BSS float g_irPartitionScratch[2 * ConvolutionSection<PARTITION_SIZE_3>::FFT_SIZE];
+
+// IR slot arena: every loaded IR with its time-domain copy and prepared
+// spectra (see IrSlot). Slots are carved out in load order and all freed
+// together by ClearIRSlots().
+static const size_t IR_SLOT_ARENA_SIZE = 13 * 1024 * 1024; // 52MB of floats
+ECHO_SDRAM_BSS float g_irSlotArena[IR_SLOT_ARENA_SIZE];
+
+// Global SDRAM buffers for predelay
+ECHO_SDRAM_BSS float g_predelayBuffer[PREDELAY_RING_SIZE];
+ECHO_SDRAM_BSS float g_predelayBufferRight[PREDELAY_RING_SIZE];
+
+// IR bank swap handshake between the main loop and the audio callback
+enum IrSwapState {
+    IR_SWAP_IDLE,       // Main loop owns the idle bank
+    IR_SWAP_PENDING,    // Idle bank prepared, taken at the next tick
+    IR_SWAP_FADING      // Audio crossfading, both banks in use
+};
+
+// Sections of the partition layout
+static const size_t IR_SECTIONS = 4;
+
+// IR slots: a slot that is prepared holds everything a bank needs, so
+// selecting it is an attach (a pointer set for the larger sections) plus a
+// bank swap. Slots stay unchanged once prepared; banks only refer to them.
+struct IrSlot {
+    IrLayout layout;
+    size_t length;                  // IR samples (0: empty slot)
+    unsigned generation;            // IR load the slot holds
+    bool prepared;                  // All partition spectra are in place
+    float* ir[IR_PATHS];            // Time-domain IR per used path
+    float* tail[IR_PATHS];          // Multirate tail: lowpassed, decimated IR per used path
+    size_t tailLength;              // Decimated samples in tail
+    float* spectra[IR_SECTIONS];    // Prepared spectra per section
+    size_t stride[IR_SECTIONS];     // Partitions per path in spectra
+    uint64_t silent[IR_SECTIONS];   // Per section: bit p set if partition p is silent on every path
+    size_t arenaStart;              // Arena range, in floats
+    size_t arenaEnd;
+};
+
+// Marks no slot in a bank
+static const size_t NO_IR_SLOT = ~static_cast<size_t>(0);
+
+// Extra slot past the loaded ones holding the playing IR with the low/high
+// cut folded in. It is carved from the top of the arena.
+static const size_t FOLD_SLOT = IR_SLOTS;
+
+// IR preparation and export run in the main loop a slice at a time, so a
+// multi-second IR never stalls controls or USB: each call transforms, reads
+// or writes about this many IR samples' worth of partitions
+static const size_t IR_PREPARE_SLICE = PARTITION_SIZE_3;
+
+// Stages of the filter fold job
+enum FoldStage {
+    FOLD_IDLE,
+    FOLD_FILTER,        // Filter the time-domain IR into the fold slot
+    FOLD_PREPARE,       // Transform the fold slot
+    FOLD_READY,
+    FOLD_FAILED         // No arena room; retried for another IR or setting
+};
+
+// Position of a sliced IR job
+struct IrJobCursor {
+    unsigned generation;    // IR load the job runs for (0: none)
+    size_t stage;           // Section, or export stage
+    size_t path;
+    size_t pos;             // Partition or sample within the path
+};
+
+// Partitioned Convolution implementation
+class PartitionedConvolutionReverb {
+private:
+    // IR slots, owned by the main loop. irSlot is the slot asked for; the
+    // highest loaded slot plays when it is past the loaded ones.
+    IrSlot slots[IR_SLOTS + 1];     // Loaded slots, then FOLD_SLOT
+    size_t slotCount;       // Slots loaded, from 0
+    size_t irSlot;
+    bool irDirty;           // Selection, IR or length changed since the last swap
+    unsigned irGeneration;  // Bumped on every IR load
+
+    // Arena use: slots are carved out from arenaUsed up, skipping the range
+    // the live bank still reads after ClearIRSlots()
+    size_t arenaUsed;
+    size_t arenaKeepStart;
+    size_t arenaKeepEnd;
+
+    // IR banks. Only the audio path changes liveBank, and only while the
+    // swap state is pending; the main loop attaches bank liveBank ^ 1 while
+    // the state is idle.
+    std::atomic<int> swapState;
+    size_t liveBank;
+    IrLayout bankLayout[IR_BANKS];
+    size_t bankSlot[IR_BANKS];          // Slot a bank is attached to (NO_IR_SLOT: none)
+    unsigned bankGeneration[IR_BANKS];  // IR load of that slot at attach time
+    size_t bankCut[IR_BANKS];           // IR length a bank is shortened to
+    size_t bankArenaStart[IR_BANKS];    // Arena range the bank reads
+    size_t bankArenaEnd[IR_BANKS];
+    bool bankFolded[IR_BANKS];          // Attached to FOLD_SLOT; plays on WET_FOLDED
+    bool wetActive;         // A bank has gone live since the sections were reset
+
+    // Sliced main loop jobs: preparing a slot (from its time-domain IR or
+    // an .ebir stream) and writing a slot as .ebir
+    IrJobCursor prepareJob;
+    bool irImport;          // importSlot is filled by ImportPrecomputedIR()
+    size_t importSlot;
+    IrJobCursor exportJob;
+
+    // Filter folding: the fold job (generation being the source slot's),
+    // the cutoffs baked into the fold slot and its filters. toneSettled is
+    // raised by the audio path once the cutoffs have held still.
+    bool filterFolding;
+    IrJobCursor foldJob;
+    float foldLowCut;
+    float foldHighCut;
+    daisysp::Svf foldLowCutFilter;
+    daisysp::Svf foldHighCutFilter;
+    std::atomic<bool> toneSettled;
+
+    // Convolution sections, smallest partitions first
+    ConvolutionSection<PARTITION_SIZE_0> section0;
+    ConvolutionSection<PARTITION_SIZE_1> section1;
+    ConvolutionSection<PARTITION_SIZE_2> section2;
+    ConvolutionSection<PARTITION_SIZE_3> section3;
+
+    // Multirate tail: the decimation factor (1: off) and the section that
+    // takes over the section 3 range at each factor. Both sides run the
+    // tail filter's nonzero taps, which tailTapOffset places in the
+    // filter; tailUpGain includes the factor.
+    size_t tailDecimation;
+    ConvolutionSection<PARTITION_SIZE_3 / 2> tail2;
+    ConvolutionSection<PARTITION_SIZE_3 / 4> tail4;
+    size_t tailTaps;
+    size_t tailTapOffset[MAX_TAIL_FILTER_TAPS];
+    float tailDownGain[MAX_TAIL_FILTER_TAPS];
+    float tailUpGain[MAX_TAIL_FILTER_TAPS];
+
+    // Wet accumulator read position, and per wet stream the samples since
+    // a bank last played on it (WET_RING_SIZE: drained, not read)
+    size_t wetReadPos;
+    size_t wetIdle[WET_STREAMS];
+
+    // Predelay buffer - using global SDRAM buffers
+    size_t predelayBufferPos;
+    size_t predelayInSamples;
+    size_t predelayFadeFrom;    // Previous tap while a predelay change fades
+    size_t predelayFadePos;
+
+    // Parameter targets, written by the setters in the main loop and
+    // ramped towards by the audio path at its own pace
+    std::atomic<float> dryWetTarget;
+    std::atomic<size_t> predelayTarget;
+    std::atomic<float> lowCutTarget;
+    std::atomic<float> highCutTarget;
+    std::atomic<float> stereoWidthTarget;
+    std::atomic<bool> freezeTarget;
+    std::atomic<bool> bypassTarget;
+    std::atomic<float> gateLevel;       // Linear peak level (0: gate off)
+
+    // Parameters, as the audio path currently applies them
+    float dryWet;           // Dry/wet mix (0.0 - 1.0)
+    float predelayMs;       // Predelay in milliseconds
+    float irLengthFactor;   // IR length factor (0.0 - 1.0)
+    float lowCutFreq;       // Low cut frequency
+    float highCutFreq;      // High cut frequency
+    float stereoWidth;      // Stereo width (0.0 - 2.0)
+    float filterSmoothing;  // Per-sample cutoff glide coefficient
+    size_t toneSettle;      // Samples the cutoffs have held still
+    size_t toneSettleSamples;
+    float sampleRate;       // Sample rate
+    bool stereoInput;       // False while the input is mono (L == R)
+    bool zeroLatency;       // First taps run as a time-domain FIR head
+    float bypassLevel;      // Bypass crossfade (0: engaged, 1: bypassed)
+
+    // DSP gate: quiet time of the reverb's input and of the wet output
+    bool gated;
+    size_t inputQuiet;
+    size_t wetQuiet;
+    size_t gateHoldSamples;
+
+    // Filters
+    daisysp::Svf lowCutFilterL;
+    daisysp::Svf highCutFilterL;
+    daisysp::Svf lowCutFilterR;
+    daisysp::Svf highCutFilterR;
+
+    static size_t LayoutPaths(IrLayout layout) {
+        if (layout == IR_LAYOUT_STEREO) return 2;
+        if (layout == IR_LAYOUT_TRUE_STEREO) return IR_PATHS;
+        return 1;
+    }
+
+    // Slot that plays for the current selection
+    size_t SelectedSlot() const {
+        return (irSlot < slotCount) ? irSlot : slotCount - 1;
+    }
+
+    // Partitions of a section stored per path, both in slots and in .ebir
+    // files. Both always use the default section offsets; in zero-latency
+    // mode section 0 leaves the partition under the FIR head unused.
+    static size_t FilePartitions(size_t length, size_t offset, size_t size, size_t maxPartitions) {
+        size_t partitions = (length > offset) ? (length - offset + size - 1) / size : 0;
+        return (partitions < maxPartitions) ? partitions : maxPartitions;
+    }
+
+    static const size_t SLOT_ALIGN = 8; // Floats; keeps every block on a 32-byte line
+
+    static size_t SlotIrSize(size_t length) {
+        return (length + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+    }
+
+    // Samples of the decimated tail IR for an IR of length samples
+    size_t TailLength(size_t length) const {
+        return (length + tailDecimation - 1) / tailDecimation;
+    }
+
+    // Partition size of the spectra a slot holds for section s. Each
+    // decimated tail partition stands for one section 3 partition.
+    size_t SlotPartitionSize(size_t s) const {
+        const size_t sizes[IR_SECTIONS] = {PARTITION_SIZE_0, PARTITION_SIZE_1, PARTITION_SIZE_2, PARTITION_SIZE_3};
+        return (s == 3) ? PARTITION_SIZE_3 / tailDecimation : sizes[s];
+    }
+
+    // Partitions per path of each section (stride) and arena floats a slot
+    // for an IR needs: the time-domain IR, the decimated tail IR with a
+    // multirate tail, then the spectra of each section, for every path the
+    // layout uses
+    void SlotLayout(IrLayout layout, size_t length, size_t* stride, size_t& size) const {
+        const size_t sizes[IR_SECTIONS] = {PARTITION_SIZE_0, PARTITION_SIZE_1, PARTITION_SIZE_2, PARTITION_SIZE_3};
+        const size_t offsets[IR_SECTIONS] = {SECTION_OFFSET_0, SECTION_OFFSET_1, SECTION_OFFSET_2, SECTION_OFFSET_3};
+        const size_t partitions[IR_SECTIONS] = {SECTION_PARTITIONS_0, SECTION_PARTITIONS_1,
+                                                SECTION_PARTITIONS_2, SECTION_PARTITIONS_3};
+
+        size_t paths = LayoutPaths(layout);
+        size = paths * SlotIrSize(length);
+        if (tailDecimation > 1) {
+            size += paths * SlotIrSize(TailLength(length));
+        }
+        for (size_t s = 0; s < IR_SECTIONS; s++) {
+            stride[s] = FilePartitions(length, offsets[s], sizes[s], partitions[s]);
+            size += paths * stride[s] * 2 * SlotPartitionSize(s); // SPECTRUM_SIZE is 2 * B
+        }
+    }
+
+    size_t SlotSize(IrLayout layout, size_t length) const {
+        size_t stride[IR_SECTIONS];
+        size_t size = 0;
+        SlotLayout(layout, length, stride, size);
+        return size;
+    }
+
+    // Lay out an empty slot at arena offset start
+    void PlaceSlot(size_t index, IrLayout layout, size_t length, size_t start) {
+        IrSlot& slot = slots[index];
+        size_t paths = LayoutPaths(layout);
+        size_t irSize = SlotIrSize(length);
+        size_t tailLength = (tailDecimation > 1) ? TailLength(length) : 0;
+        size_t tailSize = SlotIrSize(tailLength);
+        size_t size = 0;
+        SlotLayout(layout, length, slot.stride, size);
+
+        float* next = g_irSlotArena + start;
+        for (size_t path = 0; path < IR_PATHS; path++) {
+            slot.ir[path] = (path < paths) ? next + path * irSize : nullptr;
+        }
+        next += paths * irSize;
+        for (size_t path = 0; path < IR_PATHS; path++) {
+            slot.tail[path] = (path < paths && tailLength > 0) ? next + path * tailSize : nullptr;
+        }
+        next += paths * tailSize;
+        for (size_t s = 0; s < IR_SECTIONS; s++) {
+            slot.spectra[s] = next;
+            next += paths * slot.stride[s] * 2 * SlotPartitionSize(s);
+        }
+
+        slot.layout = layout;
+        slot.length = length;
+        slot.tailLength = tailLength;
+        slot.generation = ++irGeneration;
+        slot.prepared = false;
+        slot.arenaStart = start;
+        slot.arenaEnd = start + size;
+    }
+
+    // Carve an empty slot for an IR out of the arena, below the fold slot
+    // while a bank plays it; otherwise the fold slot gives way
+    bool AllocateSlot(size_t index, IrLayout layout, size_t length) {
+        size_t size = SlotSize(layout, length);
+        size_t end = IR_SLOT_ARENA_SIZE;
+        if (slots[FOLD_SLOT].length > 0) {
+            if (FoldInUse()) {
+                end = slots[FOLD_SLOT].arenaStart;
+            } else {
+                DropFold();
+            }
+        }
+
+        size_t start = arenaUsed;
+        if (start < arenaKeepEnd && start + size > arenaKeepStart && arenaKeepStart < end) {
+            start = arenaKeepEnd;
+        }
+        if (start + size > end) {
+            return false;
+        }
+
+        PlaceSlot(index, layout, length, start);
+        arenaUsed = start + size;
+
+        if (index >= slotCount) {
+            slotCount = index + 1;
+        }
+        irDirty = true;
+        return true;
+    }
+
+    // Carve the fold slot for a copy of slot source out of the top of the
+    // arena, clear of the loaded slots and of the range the live bank
+    // reads, which may be one kept after ClearIRSlots(). Only while no swap
+    // is in flight.
+    bool AllocateFold(size_t source) {
+        const IrSlot& from = slots[source];
+        size_t size = SlotSize(from.layout, from.length);
+        if (size > IR_SLOT_ARENA_SIZE - arenaUsed) {
+            return false;
+        }
+
+        size_t start = IR_SLOT_ARENA_SIZE - size;
+        if (start < bankArenaEnd[liveBank] && start + size > bankArenaStart[liveBank]) {
+            return false;
+        }
+        PlaceSlot(FOLD_SLOT, from.layout, from.length, start);
+        return true;
+    }
+
+    // Forget the fold slot; its arena range is free again
+    void DropFold() {
+        slots[FOLD_SLOT].length = 0;
+        slots[FOLD_SLOT].prepared = false;
+        foldJob.generation = 0;
+        foldJob.stage = FOLD_IDLE;
+    }
+
+    // The audio path plays the fold slot, or may be about to or fading
+    // out of it. Banks attached while a swap is idle are not in use.
+    bool FoldInUse() const {
+        return bankFolded[liveBank] ||
+               (swapState.load(std::memory_order_acquire) != IR_SWAP_IDLE && bankFolded[liveBank ^ 1]);
+    }
+
+    // The fold slot holds slot index filtered at the current cutoffs
+    bool FoldValid(size_t index) const {
+        return filterFolding && foldJob.stage == FOLD_READY && slots[FOLD_SLOT].prepared &&
+               foldJob.generation == slots[index].generation &&
+               foldLowCut == lowCutTarget.load(std::memory_order_relaxed) &&
+               foldHighCut == highCutTarget.load(std::memory_order_relaxed);
+    }
+
+    // Fill a new slot with a time-domain IR given per path
+    bool LoadSlot(size_t index, IrLayout layout, const float* const* paths, size_t length) {
+        if (index >= IR_SLOTS || index != slotCount || length == 0 || length > MAX_IR_LENGTH ||
+            !AllocateSlot(index, layout, length)) {
+            return false;
+        }
+
+        IrSlot& slot = slots[index];
+        for (size_t path = 0; path < LayoutPaths(layout); path++) {
+            memcpy(slot.ir[path], paths[path], length * sizeof(float));
+        }
+        return true;
+    }
+
+    // Advance the preparation of a slot by one slice. The spectra are
+    // transformed from the time-domain IR or, with read set, read from an
+    // .ebir stream, and silent partitions are marked as they come in. With
+    // a multirate tail section 3 holds nothing (an .ebir file's section 3
+    // spectra are read past) and two more stages decimate the tail IR and
+    // transform it. Returns false on a read error; done is set once the
+    // slot is prepared.
+    bool PrepareSlot(size_t index, EbirReadFn read, void* context, bool& done) {
+        IrSlot& slot = slots[index];
+        if (prepareJob.generation != slot.generation) {
+            prepareJob.generation = slot.generation;
+            prepareJob.stage = 0;
+            prepareJob.path = 0;
+            prepareJob.pos = 0;
+            for (size_t s = 0; s < IR_SECTIONS; s++) {
+                slot.silent[s] = ~static_cast<uint64_t>(0);
+            }
+        }
+
+        size_t stages = (tailDecimation > 1) ? IR_SECTIONS + 2 : IR_SECTIONS;
+        size_t budget = IR_PREPARE_SLICE;
+        bool ok = true;
+        while (ok && budget > 0 && prepareJob.stage < stages) {
+            switch (prepareJob.stage) {
+            case 0: ok = PrepareSection(section0, 0, SECTION_OFFSET_0, slot, read, context, budget); break;
+            case 1: ok = PrepareSection(section1, 1, SECTION_OFFSET_1, slot, read, context, budget); break;
+            case 2: ok = PrepareSection(section2, 2, SECTION_OFFSET_2, slot, read, context, budget); break;
+            case 3: ok = PrepareSection(section3, 3, SECTION_OFFSET_3, slot, read, context, budget); break;
+            case 4: DecimateTail(slot, budget); break;
+            default:
+                if (tailDecimation == 2) {
+                    PrepareTail(tail2, slot, budget);
+                } else {
+                    PrepareTail(tail4, slot, budget);
+                }
+                break;
+            }
+        }
+
+        done = ok && prepareJob.stage == stages;
+        if (done) {
+            slot.prepared = true;
+        }
+        return ok;
+    }
+
+    // One section of PrepareSlot(). .ebir files hold the partitions at the
+    // default offset, which PartitionSpectrum() maps onto this section.
+    template <size_t B>
+    bool PrepareSection(ConvolutionSection<B>& section, size_t s, size_t offset, IrSlot& slot,
+                        EbirReadFn read, void* context, size_t& budget) {
+        size_t partitions = read ? slot.stride[s] : section.PartitionsFor(slot.length);
+
+        while (budget > 0 && prepareJob.path < LayoutPaths(slot.layout)) {
+            if (prepareJob.pos == partitions) {
+                prepareJob.path++;
+                prepareJob.pos = 0;
+                continue;
+            }
+
+            size_t path = prepareJob.path;
+            size_t p = prepareJob.pos;
+            if (read) {
+                p = section.PartitionAt(slot.length, offset + prepareJob.pos * B);
+                float* spectrum = g_irPartitionScratch; // Not used by this section layout; read it past
+                if (p != ConvolutionSection<B>::NO_PARTITION) {
+                    spectrum = ConvolutionSection<B>::PreparedSpectrum(slot.spectra[s], slot.stride[s], path, p);
+                }
+                if (!read(context, spectrum, ConvolutionSection<B>::SPECTRUM_SIZE * sizeof(float))) {
+                    return false;
+                }
+            } else {
+                section.SetIRPartition(slot.spectra[s], slot.stride[s], path, slot.ir[path], slot.length,
+                                       p, g_irPartitionScratch);
+            }
+            MarkAudible<B>(slot, s, path, p);
+            prepareJob.pos++;
+            budget = (budget > B) ? budget - B : 0;
+        }
+
+        if (prepareJob.path == LayoutPaths(slot.layout)) {
+            prepareJob.stage++;
+            prepareJob.path = 0;
+            prepareJob.pos = 0;
+        }
+        return true;
+    }
+
+    // Clear the silent mark of prepared partition p of section s unless its
+    // spectrum on path is silent too
+    template <size_t B>
+    static void MarkAudible(IrSlot& slot, size_t s, size_t path, size_t p) {
+        if (p == ConvolutionSection<B>::NO_PARTITION || p >= SILENT_MASK_BITS ||
+            !((slot.silent[s] >> p) & 1)) {
+            return;
+        }
+        if (!ConvolutionSection<B>::SilentSpectrum(
+                ConvolutionSection<B>::PreparedSpectrum(slot.spectra[s], slot.stride[s], path, p))) {
+            slot.silent[s] &= ~(static_cast<uint64_t>(1) << p);
+        }
+    }
+
+    // Multirate tail stage of PrepareSlot(): lowpass the section 3 range of
+    // each path through the tail filter, centred, and keep every
+    // tailDecimation-th sample. The gain makes up for the samples dropped.
+    void DecimateTail(IrSlot& slot, size_t& budget) {
+        const size_t factor = tailDecimation;
+        const size_t centre = TAIL_FILTER_SPAN * factor - 1;
+        const size_t first = SECTION_OFFSET_3 / factor;
+
+        while (budget > 0 && prepareJob.path < LayoutPaths(slot.layout)) {
+            if (prepareJob.pos < first) {
+                prepareJob.pos = first;
+            }
+            if (prepareJob.pos >= slot.tailLength) {
+                prepareJob.path++;
+                prepareJob.pos = 0;
+                continue;
+            }
+
+            const float* ir = slot.ir[prepareJob.path];
+            float* out = slot.tail[prepareJob.path];
+            size_t end = prepareJob.pos + IR_PREPARE_SLICE / factor;
+            if (end > slot.tailLength) end = slot.tailLength;
+            for (size_t j = prepareJob.pos; j < end; j++) {
+                float acc = 0.0f;
+                for (size_t t = 0; t < tailTaps; t++) {
+                    size_t i = factor * j + centre - tailTapOffset[t];
+                    if (i >= SECTION_OFFSET_3 && i < slot.length) {
+                        acc += tailDownGain[t] * ir[i];
+                    }
+                }
+                out[j] = acc * factor;
+            }
+            prepareJob.pos = end;
+            budget = (budget > IR_PREPARE_SLICE) ? budget - IR_PREPARE_SLICE : 0;
+        }
+
+        if (prepareJob.path == LayoutPaths(slot.layout)) {
+            prepareJob.stage++;
+            prepareJob.path = 0;
+            prepareJob.pos = 0;
+        }
+    }
+
+    // Last multirate tail stage of PrepareSlot(): transform the decimated
+    // tail IR into the slot's section 3 spectra
+    template <size_t B>
+    void PrepareTail(ConvolutionSection<B>& section, IrSlot& slot, size_t& budget) {
+        size_t partitions = section.PartitionsFor(slot.tailLength);
+
+        while (budget > 0 && prepareJob.path < LayoutPaths(slot.layout)) {
+            if (prepareJob.pos == partitions) {
+                prepareJob.path++;
+                prepareJob.pos = 0;
+                continue;
+            }
+
+            size_t path = prepareJob.path;
+            section.SetIRPartition(slot.spectra[3], slot.stride[3], path, slot.tail[path], slot.tailLength,
+                                   prepareJob.pos, g_irPartitionScratch);
+            MarkAudible<B>(slot, 3, path, prepareJob.pos);
+            prepareJob.pos++;
+            budget = (budget > B) ? budget - B : 0;
+        }
+
+        if (prepareJob.path == LayoutPaths(slot.layout)) {
+            prepareJob.stage++;
+            prepareJob.path = 0;
+            prepareJob.pos = 0;
+        }
+    }
+
+    // Kaiser-windowed sinc lowpass at the decimated Nyquist frequency with
+    // unity gain at DC, for the current tail decimation. Taps on the sinc's
+    // zero crossings are left out.
+    void DesignTailFilter() {
+        tailTaps = 0;
+        if (tailDecimation == 1) {
+            return;
+        }
+
+        const size_t factor = tailDecimation;
+        const size_t centre = TAIL_FILTER_SPAN * factor - 1;
+        float sum = 0.0f;
+        for (size_t t = 0; t <= 2 * centre; t++) {
+            size_t distance = (t > centre) ? t - centre : centre - t;
+            if (distance != 0 && distance % factor == 0) {
+                continue;
+            }
+
+            float ratio = (float)distance / centre;
+            float window = BesselI0(TAIL_FILTER_BETA * sqrtf(1.0f - ratio * ratio)) / BesselI0(TAIL_FILTER_BETA);
+            float arg = 3.14159265f * distance / factor;
+            float gain = (distance == 0) ? window : window * sinf(arg) / arg;
+            tailTapOffset[tailTaps] = t;
+            tailDownGain[tailTaps] = gain;
+            sum += gain;
+            tailTaps++;
+        }
+
+        for (size_t t = 0; t < tailTaps; t++) {
+            tailDownGain[t] /= sum;
+            tailUpGain[t] = tailDownGain[t] * factor;
+        }
+    }
+
+    // Zeroth-order modified Bessel function of the first kind, for the
+    // Kaiser window
+    static float BesselI0(float x) {
+        float sum = 1.0f;
+        float term = 1.0f;
+        for (size_t k = 1; k < 32; k++) {
+            float half = x / (2.0f * k);
+            term *= half * half;
+            sum += term;
+        }
+        return sum;
+    }
+
+    // Attach a multirate tail section to section 3's storage. Its deposits
+    // come forward by the centres of both tail filters, less the part the
+    // decimator's output timing already makes up, and its jobs get a tick
+    // less where that eats into their slack.
+    template <size_t B>
+    void InitTail(ConvolutionSection<B>& tail, float* acc) {
+        const size_t factor = tailDecimation;
+        size_t delay = 2 * (TAIL_FILTER_SPAN * factor - 1) - (factor - 1);
+        size_t jobTicks = (PARTITION_SIZE_3 - delay) / SCHEDULER_TICK + 1;
+        if (jobTicks > PARTITION_SIZE_3 / SCHEDULER_TICK) jobTicks = PARTITION_SIZE_3 / SCHEDULER_TICK;
+
+        tail.Init(SECTION_OFFSET_3 / factor, SECTION_PARTITIONS_3, jobTicks,
+                  nullptr, g_taper3, g_fdl3, g_input3, acc);
+        tail.SetRate(factor, tailUpGain, tailTapOffset, tailTaps, delay);
+    }
+
+    // Attach the idle bank to a prepared slot: a copy of the section 0/1
+    // spectra into fast memory, pointers for the rest
+    void AttachBank(size_t bank, size_t index) {
+        IrSlot& slot = slots[index];
+        size_t paths = LayoutPaths(slot.layout);
+        section0.AttachBank(bank, slot.spectra[0], slot.stride[0], slot.length, paths, slot.silent[0]);
+        section1.AttachBank(bank, slot.spectra[1], slot.stride[1], slot.length, paths, slot.silent[1]);
+        section2.AttachBank(bank, slot.spectra[2], slot.stride[2], slot.length, paths, slot.silent[2]);
+        if (tailDecimation == 2) {
+            tail2.AttachBank(bank, slot.spectra[3], slot.stride[3], slot.tailLength, paths, slot.silent[3]);
+        } else if (tailDecimation == 4) {
+            tail4.AttachBank(bank, slot.spectra[3], slot.stride[3], slot.tailLength, paths, slot.silent[3]);
+        } else {
+            section3.AttachBank(bank, slot.spectra[3], slot.stride[3], slot.length, paths, slot.silent[3]);
+        }
+
+        bankLayout[bank] = slot.layout;
+        bankSlot[bank] = index;
+        bankFolded[bank] = index == FOLD_SLOT;
+        bankGeneration[bank] = slot.generation;
+        bankCut[bank] = NO_IR_SLOT;
+        bankArenaStart[bank] = slot.arenaStart;
+        bankArenaEnd[bank] = slot.arenaEnd;
+    }
+
+    // Shorten an attached bank to cut samples and fill its FIR head taps.
+    // Shortening drops whole partitions and fades out the last one.
+    void ApplyLength(size_t bank, size_t cut) {
+        const IrSlot& slot = slots[bankSlot[bank]];
+        size_t paths = LayoutPaths(slot.layout);
+        bool taper = cut < slot.length;
+
+        for (size_t path = 0; path < paths; path++) {
+            const float* ir = slot.ir[path];
+
+            // FIR head taps, stored reversed for the block kernel. A cut
+            // inside the head is always at its end.
+            for (size_t k = 0; k < FIR_HEAD_LENGTH; k++) {
+                size_t tap = FIR_HEAD_LENGTH - 1 - k;
+                float value = (tap < cut && tap < slot.length) ? ir[tap] : 0.0f;
+                if (taper && cut <= FIR_HEAD_LENGTH) {
+                    value *= IrTaperGain(tap, FIR_HEAD_LENGTH);
+                }
+                firTaps[bank][path][k] = value;
+            }
+        }
+
+        section0.SetLength(bank, cut, taper, paths, slot.ir, slot.length, g_irPartitionScratch);
+        section1.SetLength(bank, cut, taper, paths, slot.ir, slot.length, g_irPartitionScratch);
+        section2.SetLength(bank, cut, taper, paths, slot.ir, slot.length, g_irPartitionScratch);
+        if (tailDecimation == 2) {
+            tail2.SetLength(bank, cut / 2, taper, paths, slot.tail, slot.tailLength, g_irPartitionScratch);
+        } else if (tailDecimation == 4) {
+            tail4.SetLength(bank, cut / 4, taper, paths, slot.tail, slot.tailLength, g_irPartitionScratch);
+        } else {
+            section3.SetLength(bank, cut, taper, paths, slot.ir, slot.length, g_irPartitionScratch);
+        }
+        bankCut[bank] = cut;
+    }
+
+    // IR length selected by the length factor, on a partition boundary
+    size_t LengthCut(size_t slotLength) const {
+        size_t length = (size_t)(slotLength * irLengthFactor);
+        if (length > slotLength) length = slotLength;
+        return (length > 0) ? IrLengthCut(length) : 0;
+    }
+
+    // UpdateIR() step for a changed selection, IR, length or cutoff:
+    // prepare the selected slot and attach the idle bank to it, or to the
+    // fold slot when that holds the selected IR at the current cutoffs.
+    // Returns false while that is still in progress.
+    bool HandOverSlot() {
+        if (slotCount == 0) {
+            irDirty = false;
+            return true;
+        }
+
+        size_t index = SelectedSlot();
+        if (FoldValid(index)) {
+            index = FOLD_SLOT;
+        }
+        IrSlot& slot = slots[index];
+        if (!slot.prepared) {
+            bool done = false;
+            PrepareSlot(index, nullptr, nullptr, done);
+            if (!done) {
+                return false;
+            }
+        }
+        if (swapState.load(std::memory_order_acquire) != IR_SWAP_IDLE) {
+            return false;
+        }
+
+        // Length changes inside one partition leave the IR as it is
+        size_t cut = LengthCut(slot.length);
+        irDirty = false;
+        if (bankSlot[liveBank] == index && bankGeneration[liveBank] == slot.generation &&
+            bankCut[liveBank] == cut) {
+            return true;
+        }
+
+        size_t bank = liveBank ^ 1;
+        if (bankSlot[bank] != index || bankGeneration[bank] != slot.generation) {
+            AttachBank(bank, index);
+        }
+        ApplyLength(bank, cut);
+
+        swapState.store(IR_SWAP_PENDING, std::memory_order_release);
+        return true;
+    }
+
+    // Background preparation: one slice of the first slot not yet
+    // prepared. Returns true once all slots are.
+    bool PrepareNextSlot() {
+        for (size_t i = 0; i < slotCount; i++) {
+            if (!slots[i].prepared) {
+                bool done = false;
+                PrepareSlot(i, nullptr, nullptr, done);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Background filter folding: once the cutoffs have settled, filter the
+    // selected IR into the fold slot through the same low/high cut as the
+    // wet path, a slice per call, and transform it. HandOverSlot() then
+    // swaps it in, and the wet filters stop running. Returns false while
+    // a fold is in progress.
+    bool FoldFilters() {
+        if (!filterFolding || slotCount == 0) {
+            return true;
+        }
+
+        size_t source = SelectedSlot();
+        float low = lowCutTarget.load(std::memory_order_relaxed);
+        float high = highCutTarget.load(std::memory_order_relaxed);
+        if (foldJob.generation != slots[source].generation || foldLowCut != low || foldHighCut != high) {
+            // Fold again only for a setting that has held still, and never
+            // over a fold slot the audio path still reads
+            if (!toneSettled.load(std::memory_order_acquire)) {
+                return true;
+            }
+            if (swapState.load(std::memory_order_acquire) != IR_SWAP_IDLE || FoldInUse()) {
+                return false;
+            }
+
+            foldJob.generation = slots[source].generation;
+            foldJob.stage = AllocateFold(source) ? FOLD_FILTER : FOLD_FAILED;
+            foldJob.path = 0;
+            foldJob.pos = 0;
+            foldLowCut = low;
+            foldHighCut = high;
+        }
+
+        IrSlot& fold = slots[FOLD_SLOT];
+        switch (foldJob.stage) {
+        case FOLD_FILTER:
+            FoldSlice(slots[source], fold);
+            return false;
+
+        case FOLD_PREPARE: {
+            bool done = false;
+            PrepareSlot(FOLD_SLOT, nullptr, nullptr, done);
+            if (done) {
+                foldJob.stage = FOLD_READY;
+                irDirty = true;
+            }
+            return false;
+        }
+
+        default:
+            return true;
+        }
+    }
+
+    // One slice of FoldFilters(): run IR_PREPARE_SLICE samples of a path
+    // through the fold filters, which restart for each path
+    void FoldSlice(const IrSlot& source, IrSlot& fold) {
+        if (foldJob.pos == 0) {
+            foldLowCutFilter.Init(sampleRate);
+            foldHighCutFilter.Init(sampleRate);
+            foldLowCutFilter.SetRes(0.707f);
+            foldLowCutFilter.SetDrive(0.0f);
+            foldHighCutFilter.SetRes(0.707f);
+            foldHighCutFilter.SetDrive(0.0f);
+            foldLowCutFilter.SetFreq(foldLowCut);
+            foldHighCutFilter.SetFreq(foldHighCut);
+        }
+
+        const float* in = source.ir[foldJob.path];
+        float* out = fold.ir[foldJob.path];
+        size_t end = foldJob.pos + IR_PREPARE_SLICE;
+        if (end > source.length) end = source.length;
+        for (size_t i = foldJob.pos; i < end; i++) {
+            foldLowCutFilter.Process(in[i]);
+            foldHighCutFilter.Process(foldLowCutFilter.High());
+            out[i] = foldHighCutFilter.Low();
+        }
+
+        foldJob.pos = end;
+        if (foldJob.pos == source.length) {
+            foldJob.pos = 0;
+            if (++foldJob.path == LayoutPaths(source.layout)) {
+                foldJob.stage = FOLD_PREPARE;
+            }
+        }
+    }
+
+    // Export stage writing the time-domain IR, a slice of samples at a time
+    bool ExportSamples(const IrSlot& slot, EbirWriteFn write, void* context, size_t& budget) {
+        while (budget > 0 && exportJob.path < LayoutPaths(slot.layout)) {
+            size_t count = slot.length - exportJob.pos;
+            if (count > budget) count = budget;
+
+            if (!write(context, slot.ir[exportJob.path] + exportJob.pos, count * sizeof(float))) {
+                return false;
+            }
+            exportJob.pos += count;
+            budget -= count;
+
+            if (exportJob.pos == slot.length) {
+                exportJob.path++;
+                exportJob.pos = 0;
+            }
+        }
+
+        if (exportJob.path == LayoutPaths(slot.layout)) {
+            exportJob.stage++;
+            exportJob.path = 0;
+        }
+        return true;
+    }
+
+    // Export stage writing the spectra of one section. Partitions a section
+    // does not hold in this latency mode are transformed.
+    template <size_t B>
+    bool ExportSpectra(ConvolutionSection<B>& section, size_t s, size_t offset, const IrSlot& slot,
+                       EbirWriteFn write, void* context, size_t& budget) {
+        float* out = g_irPartitionScratch + ConvolutionSection<B>::FFT_SIZE;
+
+        while (budget > 0 && exportJob.path < LayoutPaths(slot.layout)) {
+            if (exportJob.pos == slot.stride[s]) {
+                exportJob.path++;
+                exportJob.pos = 0;
+                continue;
+            }
+
+            size_t path = exportJob.path;
+            const float* spectrum = section.PlainSpectrum(slot.spectra[s], slot.stride[s], path, slot.ir[path],
+                                                          slot.length, offset + exportJob.pos * B,
+                                                          g_irPartitionScratch, out);
+            if (!write(context, spectrum, ConvolutionSection<B>::SPECTRUM_SIZE * sizeof(float))) {
+                return false;
+            }
+            exportJob.pos++;
+            budget = (budget > B) ? budget - B : 0;
+        }
+
+        if (exportJob.path == LayoutPaths(slot.layout)) {
+            exportJob.stage++;
+            exportJob.path = 0;
+        }
+        return true;
+    }
+
+public:
+    PartitionedConvolutionReverb() :
+        slotCount(0),
+        irSlot(0),
+        irDirty(false),
+        irGeneration(0),
+        arenaUsed(0),
+        arenaKeepStart(0),
+        arenaKeepEnd(0),
+        swapState(IR_SWAP_IDLE),
+        liveBank(0),
+        bankLayout{IR_LAYOUT_MONO, IR_LAYOUT_MONO},
+        bankSlot{NO_IR_SLOT, NO_IR_SLOT},
+        bankGeneration{0, 0},
+        bankCut{0, 0},
+        bankArenaStart{0, 0},
+        bankArenaEnd{0, 0},
+        bankFolded{false, false},
+        wetActive(false),
+        prepareJob{0, 0, 0, 0},
+        irImport(false),
+        importSlot(0),
+        exportJob{0, 0, 0, 0},
+        filterFolding(false),
+        foldJob{0, FOLD_IDLE, 0, 0},
+        foldLowCut(0.0f),
+        foldHighCut(0.0f),
+        toneSettled(false),
+        tailDecimation(1),
+        tailTaps(0),
+        wetReadPos(0),
+        wetIdle{WET_RING_SIZE, WET_RING_SIZE},
+        predelayBufferPos(0),
+        predelayInSamples(0),
+        predelayFadeFrom(0),
+        predelayFadePos(PREDELAY_FADE),
+        dryWetTarget(0.5f),
+        predelayTarget(0),
+        lowCutTarget(100.0f),
+        highCutTarget(10000.0f),
+        stereoWidthTarget(1.0f),
+        freezeTarget(false),
+        bypassTarget(false),
+        gateLevel(0.0f),
+        dryWet(0.5f),
+        predelayMs(0.0f),
+        irLengthFactor(1.0f),
+        lowCutFreq(100.0f),
+        highCutFreq(10000.0f),
+        stereoWidth(1.0f),
+        filterSmoothing(1.0f),
+        toneSettle(0),
+        toneSettleSamples(0),
+        sampleRate(48000.0f),
+        stereoInput(true),
+        zeroLatency(false),
+        bypassLevel(0.0f),
+        gated(false),
+        inputQuiet(0),
+        wetQuiet(0),
+        gateHoldSamples(0),
+        tickPos(0),
+        firFadePos(FIR_HEAD_LENGTH),
+        tailPhase(0)
+    {
+        for (size_t i = 0; i <= FOLD_SLOT; i++) {
+            slots[i].length = 0;
+            slots[i].generation = 0;
+            slots[i].prepared = false;
+        }
+    }
+
+    // Initialize with sample rate
+    void Init(float sample_rate) {
+        sampleRate = sample_rate;
+
+        // Attach section storage and clear it - must be done after hardware
+        // initialization for SDRAM buffers
+        ConfigureSections();
+
+        memset(g_predelayBuffer, 0, sizeof(g_predelayBuffer));
+        memset(g_predelayBufferRight, 0, sizeof(g_predelayBufferRight));
+        freezer.Init();
+
+        // Initialize filters with sample rate
+        lowCutFilterL.Init(sampleRate);
+        highCutFilterL.Init(sampleRate);
+        lowCutFilterR.Init(sampleRate);
+        highCutFilterR.Init(sampleRate);
+
+        // No drive: the filters stay linear, so folding them into the IR
+        // (see FoldFilters()) sounds the same as running them
+        lowCutFilterL.SetRes(0.707f);
+        lowCutFilterL.SetDrive(0.0f);
+        highCutFilterL.SetRes(0.707f);
+        highCutFilterL.SetDrive(0.0f);
+        lowCutFilterR.SetRes(0.707f);
+        lowCutFilterR.SetDrive(0.0f);
+        highCutFilterR.SetRes(0.707f);
+        highCutFilterR.SetDrive(0.0f);
+
+        // Start at the targets instead of gliding to them
+        filterSmoothing = 1.0f - expf(-1.0f / (FILTER_SMOOTHING_SECONDS * sampleRate));
+        toneSettleSamples = (size_t)(FOLD_SETTLE_SECONDS * sampleRate);
+        gateHoldSamples = (size_t)(GATE_HOLD_SECONDS * sampleRate);
+        SetGateThreshold(GATE_THRESHOLD_DB);
+        lowCutFreq = lowCutTarget.load(std::memory_order_relaxed);
+        highCutFreq = highCutTarget.load(std::memory_order_relaxed);
+        UpdateFilters();
+    }
+
+    // Enable the zero-latency FIR head. Rebuilds the section layout and
+    // clears the reverb state, so call it before starting audio. Section 0
+    // spectra depend on the layout, so every slot is prepared again.
+    void SetZeroLatency(bool enabled) {
+        zeroLatency = enabled;
+        ConfigureSections();
+        for (size_t i = 0; i < slotCount; i++) {
+            slots[i].prepared = false;
+        }
+        DropFold();
+        irDirty = slotCount > 0;
+        UpdateIR();
+    }
+
+    // Fold the low/high cut into a filtered copy of the playing IR once the
+    // cutoffs settle, so the wet filters only run while the tone knob
+    // moves. Needs arena room for one more copy of the playing IR.
+    void SetFilterFolding(bool enabled) {
+        filterFolding = enabled;
+        irDirty = slotCount > 0;
+    }
+
+    // Run the section 3 range of the IR (from 170ms on) at 1/factor of the
+    // sample rate, factor being 2 or 4 (1: off). The tail is band-limited
+    // to below a quarter or an eighth of the sample rate; its MACs, FFTs and
+    // spectra shrink by the factor. The slot layout changes, so this drops
+    // every loaded IR along with the reverb state; call it before starting
+    // audio and loading IRs.
+    void SetTailDecimation(size_t factor) {
+        tailDecimation = (factor == 2 || factor == 4) ? factor : 1;
+        DesignTailFilter();
+        ConfigureSections();
+        ClearIRSlots();
+    }
+
+    // (Re)attach section storage for the current latency and tail mode and
+    // clear the wet path and both IR banks
+    void ConfigureSections() {
+        size_t offset0 = zeroLatency ? FIR_HEAD_LENGTH : SECTION_OFFSET_0;
+        size_t partitions0 = zeroLatency ? SECTION_PARTITIONS_0 - FIR_HEAD_PARTITIONS : SECTION_PARTITIONS_0;
+
+        float* scratch = g_scratchArena;
+        section0.Init(offset0, partitions0, PARTITION_SIZE_0 / SCHEDULER_TICK,
+                      g_irSpectra0, g_taper0, g_fdl0, g_input0, scratch);
+        scratch += ConvolutionSection<PARTITION_SIZE_0>::SPECTRUM_SIZE;
+        section1.Init(SECTION_OFFSET_1, SECTION_PARTITIONS_1, PARTITION_SIZE_1 / SCHEDULER_TICK,
+                      g_irSpectra1, g_taper1, g_fdl1, g_input1, scratch);
+        scratch += ConvolutionSection<PARTITION_SIZE_1>::SPECTRUM_SIZE;
+        section2.Init(SECTION_OFFSET_2, SECTION_PARTITIONS_2, PARTITION_SIZE_2 / SCHEDULER_TICK,
+                      nullptr, g_taper2, g_fdl2, g_input2, scratch);
+        scratch += ConvolutionSection<PARTITION_SIZE_2>::SPECTRUM_SIZE;
+        section3.Init(SECTION_OFFSET_3, (tailDecimation > 1) ? 0 : SECTION_PARTITIONS_3,
+                      PARTITION_SIZE_3 / SCHEDULER_TICK, nullptr, g_taper3, g_fdl3, g_input3, scratch);
+        if (tailDecimation == 2) {
+            InitTail(tail2, scratch);
+        } else if (tailDecimation == 4) {
+            InitTail(tail4, scratch);
+        }
+        memset(tailInput, 0, sizeof(tailInput));
+        tailPhase = 0;
+
+        memset(g_wetRing, 0, sizeof(g_wetRing));
+        memset(g_wetRingRight, 0, sizeof(g_wetRingRight));
+        memset(g_wetRingFolded, 0, sizeof(g_wetRingFolded));
+        memset(g_wetRingFoldedRight, 0, sizeof(g_wetRingFoldedRight));
+        wetIdle[WET_FILTERED] = WET_RING_SIZE;
+        wetIdle[WET_FOLDED] = WET_RING_SIZE;
+        memset(firInput, 0, sizeof(firInput));
+        tickPos = 0;
+        firFadePos = FIR_HEAD_LENGTH;
+
+        liveBank = 0;
+        for (size_t bank = 0; bank < IR_BANKS; bank++) {
+            bankSlot[bank] = NO_IR_SLOT;
+            bankGeneration[bank] = 0;
+            bankArenaStart[bank] = 0;
+            bankArenaEnd[bank] = 0;
+            bankFolded[bank] = false;
+        }
+        prepareJob.generation = 0;
+        wetActive = false;
+        swapState.store(IR_SWAP_IDLE);
+        freezer.Reset();
+        gated = false;
+        inputQuiet = 0;
+        wetQuiet = 0;
+    }
+
+    // Hand the selected slot, at the current length, to the audio path,
+    // which swaps it in at the next scheduler tick. A prepared slot only
+    // needs the idle bank attached to it; a slot still being prepared is
+    // transformed IR_PREPARE_SLICE samples per call while the audio keeps
+    // the live bank. After that the remaining slots are prepared in the
+    // background so selecting them later is instant, and then the filters
+    // are folded in (see SetFilterFolding()). While any of this, an .ebir
+    // import or a swap is in flight the work stays queued; call this from
+    // the main loop until it returns true.
+    bool UpdateIR() {
+        if (irImport) {
+            return false;
+        }
+
+        if (irDirty && !HandOverSlot()) {
+            // Use the wait for a swap to get on with the other slots
+            if (slots[SelectedSlot()].prepared) {
+                PrepareNextSlot();
+            }
+            return false;
+        }
+        return PrepareNextSlot() && FoldFilters();
+    }
+
+    // Empty all IR slots before loading a new set. The live bank keeps
+    // playing its IR, whose arena range is left alone, until a new slot
+    // is selected. Fails while a swap is in flight; call again.
+    bool ClearIRSlots() {
+        if (swapState.load(std::memory_order_acquire) != IR_SWAP_IDLE) {
+            return false;
+        }
+
+        arenaKeepStart = bankArenaStart[liveBank];
+        arenaKeepEnd = bankArenaEnd[liveBank];
+        arenaUsed = 0;
+
+        for (size_t i = 0; i < IR_SLOTS; i++) {
+            slots[i].length = 0;
+            slots[i].prepared = false;
+        }
+        slotCount = 0;
+
+        // A fold slot the live bank plays stays in the arena until it is
+        // swapped out, but no longer matches any slot
+        if (bankFolded[liveBank]) {
+            foldJob.generation = 0;
+            foldJob.stage = FOLD_IDLE;
+        } else {
+            DropFold();
+        }
+        bankSlot[0] = NO_IR_SLOT;
+        bankSlot[1] = NO_IR_SLOT;
+
+        irDirty = false;
+        irImport = false;
+        prepareJob.generation = 0;
+        exportJob.generation = 0;
+        return true;
+    }
+
+    // Play slot index, or the highest loaded slot if it is past them
+    void SelectIRSlot(size_t index) {
+        if (index != irSlot) {
+            irSlot = index;
+            irDirty = true;
+        }
+    }
+
+    size_t IRSlotCount() const {
+        return slotCount;
+    }
+
+    // Slot the current selection plays, NO_IR_SLOT with none loaded
+    size_t PlayingIRSlot() const {
+        return (slotCount > 0) ? SelectedSlot() : NO_IR_SLOT;
+    }
+
+    // Load a mono IR into slot index. Slots fill in order from 0 and each
+    // only once between ClearIRSlots() calls. Fails when the IR does not
+    // fit in the slot arena.
+    bool LoadIR(size_t index, float* buffer, size_t length) {
+        const float* paths[] = {buffer};
+        if (!LoadSlot(index, IR_LAYOUT_MONO, paths, length)) {
+            return false;
+        }
+
+        // Prepare the spectra
+        UpdateIR();
+        return true;
+    }
+
+    // Load a stereo IR pair into slot index
+    bool LoadStereoIR(size_t index, float* bufferL, float* bufferR, size_t length) {
+        const float* paths[] = {bufferL, bufferR};
+        if (!LoadSlot(index, IR_LAYOUT_STEREO, paths, length)) {
+            return false;
+        }
+
+        // Prepare the spectra
+        UpdateIR();
+        return true;
+    }
+
+    // Load a true-stereo IR matrix (named input then output, so lr is the
+    // left input's response at the right output) into slot index
+    bool LoadTrueStereoIR(size_t index, float* ll, float* lr, float* rl, float* rr, size_t length) {
+        const float* paths[] = {ll, rr, lr, rl}; // IR_PATH_* order
+        if (!LoadSlot(index, IR_LAYOUT_TRUE_STEREO, paths, length)) {
+            return false;
+        }
+
+        // Prepare the spectra
+        UpdateIR();
+        return true;
+    }
+
+    // Identifies the partition layout and spectrum format in .ebir files
+    static uint32_t SpectraLayoutHash() {
+        const uint32_t values[] = {
+            PARTITION_SIZE_0, PARTITION_SIZE_1, PARTITION_SIZE_2, PARTITION_SIZE_3,
+            SECTION_OFFSET_0, SECTION_OFFSET_1, SECTION_OFFSET_2, SECTION_OFFSET_3,
+            SECTION_PARTITIONS_0, SECTION_PARTITIONS_1, SECTION_PARTITIONS_2, SECTION_PARTITIONS_3,
+            1 // Packed real FFT spectra, Nyquist in the imaginary DC slot
+        };
+        uint32_t hash = EBIR_HASH_SEED;
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+            hash = EbirHash(hash, values[i]);
+        }
+        return hash;
+    }
+
+    // Write the IR of slot index and its partition spectra in .ebir format,
+    // one slice per call; call until it no longer returns EBIR_BUSY. Waits
+    // for UpdateIR() to prepare the slot instead of transforming twice.
+    // sourceHash identifies the IR's source files.
+    EbirStatus ExportIR(size_t index, EbirWriteFn write, void* context, uint32_t sourceHash) {
+        if (index >= slotCount) {
+            return EBIR_FAILED;
+        }
+
+        const IrSlot& slot = slots[index];
+        if (!slot.prepared) {
+            return EBIR_BUSY;
+        }
+
+        size_t budget = IR_PREPARE_SLICE;
+        bool ok = true;
+        if (exportJob.generation != slot.generation) {
+            exportJob.generation = slot.generation;
+            exportJob.stage = 0;
+            exportJob.path = 0;
+            exportJob.pos = 0;
+
+            EbirHeader header;
+            memcpy(header.magic, EBIR_MAGIC, sizeof(header.magic));
+            header.version = EBIR_VERSION;
+            header.layoutHash = SpectraLayoutHash();
+            header.sampleRate = (uint32_t)sampleRate;
+            header.sourceHash = sourceHash;
+            header.layout = slot.layout;
+            header.paths = LayoutPaths(slot.layout);
+            header.length = slot.length;
+            ok = write(context, &header, sizeof(header));
+        }
+
+        while (ok && budget > 0 && exportJob.stage < 1 + IR_SECTIONS) {
+            switch (exportJob.stage) {
+            case 0: ok = ExportSamples(slot, write, context, budget); break;
+            case 1: ok = ExportSpectra(section0, 0, SECTION_OFFSET_0, slot, write, context, budget); break;
+            case 2: ok = ExportSpectra(section1, 1, SECTION_OFFSET_1, slot, write, context, budget); break;
+            case 3: ok = ExportSpectra(section2, 2, SECTION_OFFSET_2, slot, write, context, budget); break;
+            default: ok = ExportSpectra(section3, 3, SECTION_OFFSET_3, slot, write, context, budget); break;
+            }
+        }
+
+        if (ok && exportJob.stage < 1 + IR_SECTIONS) {
+            return EBIR_BUSY;
+        }
+
+        // The next call starts a new file
+        exportJob.generation = 0;
+        return ok ? EBIR_DONE : EBIR_FAILED;
+    }
+
+    // Bytes ExportIR() writes for slot index, or with spectra false the
+    // bytes up to the end of its time-domain IR
+    size_t ExportIRSize(size_t index, bool spectra) const {
+        if (index >= slotCount) {
+            return 0;
+        }
+
+        const IrSlot& slot = slots[index];
+        size_t paths = LayoutPaths(slot.layout);
+        size_t size = sizeof(EbirHeader) + paths * slot.length * sizeof(float);
+        if (spectra) {
+            const size_t sizes[IR_SECTIONS] = {PARTITION_SIZE_0, PARTITION_SIZE_1, PARTITION_SIZE_2, PARTITION_SIZE_3};
+            for (size_t s = 0; s < IR_SECTIONS; s++) {
+                size += paths * slot.stride[s] * 2 * sizes[s] * sizeof(float); // SPECTRUM_SIZE is 2 * B
+            }
+        }
+        return size;
+    }
+
+    // Load an IR from an .ebir file into slot index. header has been read
+    // and checked by the caller and paths holds the time-domain IR in
+    // IR_PATH_* order. The spectra that follow in the file are then
+    // streamed straight into the slot by ImportPrecomputedIR(); if they were
+    // made for another layout the IR is transformed as with LoadIR() instead.
+    bool LoadPrecomputedIR(size_t index, const EbirHeader& header, const float* const* paths) {
+        if (header.layout > IR_LAYOUT_TRUE_STEREO ||
+            header.paths != LayoutPaths(static_cast<IrLayout>(header.layout)) ||
+            !LoadSlot(index, static_cast<IrLayout>(header.layout), paths, header.length)) {
+            return false;
+        }
+
+        irImport = header.layoutHash == SpectraLayoutHash() && header.sampleRate == (uint32_t)sampleRate;
+        importSlot = index;
+        return true;
+    }
+
+    // Read the next slice of spectra after LoadPrecomputedIR(); call until
+    // it no longer returns EBIR_BUSY. On a read error (EBIR_FAILED) the IR
+    // is transformed from its time-domain copy instead. UpdateIR() then
+    // hands the slot over if it is selected.
+    EbirStatus ImportPrecomputedIR(EbirReadFn read, void* context) {
+        if (!irImport) {
+            return EBIR_DONE;
+        }
+
+        bool done = false;
+        if (!PrepareSlot(importSlot, read, context, done)) {
+            irImport = false;
+            prepareJob.generation = 0;
+            return EBIR_FAILED;
+        }
+        if (!done) {
+            return EBIR_BUSY;
+        }
+
+        irImport = false;
+        return EBIR_DONE;
+    }
+
+    // Set dry/wet mix. Like the predelay, filter and width setters this
+    // only publishes a target; the audio path ramps to it per chunk.
+    void SetDryWet(float value) {
+        dryWetTarget.store(value, std::memory_order_relaxed);
+    }
+
+    // Set predelay in milliseconds
+    void SetPredelay(float ms) {
+        predelayMs = ms;
+        size_t samples = (size_t)(predelayMs * sampleRate / 1000.0f);
+        if (samples >= MAX_PREDELAY_SAMPLES) {
+            samples = MAX_PREDELAY_SAMPLES - 1;
+        }
+        predelayTarget.store(samples, std::memory_order_relaxed);
+    }
+
+    // Set IR length factor. UpdateIR() applies it off the audio path by
+    // dropping partitions, without re-transforming the IR.
+    void SetIRLengthFactor(float factor) {
+        if (factor != irLengthFactor) {
+            irLengthFactor = factor;
+            irDirty = slotCount > 0;
+            UpdateIR();
+        }
+    }
+
+    // Set low cut frequency. With filter folding a new cutoff swaps the
+    // unfolded IR back in, so the wet filters follow the knob again.
+    void SetLowCut(float freq) {
+        if (freq != lowCutTarget.load(std::memory_order_relaxed)) {
+            lowCutTarget.store(freq, std::memory_order_relaxed);
+            if (filterFolding && slotCount > 0) {
+                irDirty = true;
+            }
+        }
+    }
+
+    // Set high cut frequency
+    void SetHighCut(float freq) {
+        if (freq != highCutTarget.load(std::memory_order_relaxed)) {
+            highCutTarget.store(freq, std::memory_order_relaxed);
+            if (filterFolding && slotCount > 0) {
+                irDirty = true;
+            }
+        }
+    }
+
+    // Set stereo width
+    void SetStereoWidth(float width) {
+        stereoWidthTarget.store(width, std::memory_order_relaxed);
+    }
+
+    // Hold the reverb as an endless sustain of its last 85ms, resynthesized
+    // with fresh phases (see SpectralFreeze), while the dry input plays on
+    // top. Once the sustain has faded in the convolution stops; IR swaps
+    // wait until the freeze is released and the reverb carries on.
+    void SetFreeze(bool frozen) {
+        freezeTarget.store(frozen, std::memory_order_relaxed);
+    }
+
+    // Bypass with spillover: the dry signal passes at unity gain while the
+    // reverb stops taking input and its tail rings out underneath
+    void SetBypass(bool bypassed) {
+        bypassTarget.store(bypassed, std::memory_order_relaxed);
+    }
+
+    // Peak level in dB below which input and tail count as silent for the
+    // DSP gate (0: gate off). With the gate on, the convolution pauses once
+    // both have been silent for GATE_HOLD_SECONDS and wakes on input.
+    void SetGateThreshold(float thresholdDb) {
+        float level = (thresholdDb < 0.0f) ? powf(10.0f, thresholdDb / 20.0f) : 0.0f;
+        gateLevel.store(level, std::memory_order_relaxed);
+    }
+
+    // The convolution is paused by the DSP gate
+    bool Gated() const {
+        return gated;
+    }
+
+    // Tell the engine whether the input carries distinct L/R signals. While
+    // it is mono only the left input is transformed, and with a mono IR a
+    // single convolution feeds both outputs.
+    void SetStereoInput(bool stereo) {
+        stereoInput = stereo;
+    }
+
+    // Update filter cutoffs
+    void UpdateFilters() {
+        lowCutFilterL.SetFreq(lowCutFreq);
+        highCutFilterL.SetFreq(highCutFreq);
+        lowCutFilterR.SetFreq(lowCutFreq);
+        highCutFilterR.SetFreq(highCutFreq);
+    }
+
+    // Process a block of audio. in/out hold the left and right channels.
+    // The block is handled in chunks that end on scheduler tick boundaries,
+    // so the convolution jobs fire between chunks.
+    ECHO_FAST_CODE void ProcessBlock(const float* const* in, float* const* out, size_t n) {
+        // Pass through until the first IR goes live. Nothing is running yet,
+        // so that first bank can be taken on any block boundary.
+        if (!wetActive) {
+            if (swapState.load(std::memory_order_acquire) != IR_SWAP_PENDING) {
+                memcpy(out[0], in[0], n * sizeof(float));
+                memcpy(out[1], in[1], n * sizeof(float));
+                return;
+            }
+            SwapBank();
+        }
+
+        size_t done = 0;
+        while (done < n) {
+            size_t chunk = SCHEDULER_TICK - tickPos;
+            if (chunk > n - done) chunk = n - done;
+            ProcessChunk(in[0] + done, in[1] + done, out[0] + done, out[1] + done, chunk);
+            done += chunk;
+        }
+    }
+
+private:
+    // Scratch for one chunk (at most one scheduler tick)
+    float delayedL[SCHEDULER_TICK];
+    float delayedR[SCHEDULER_TICK];
+    float wetL[SCHEDULER_TICK];
+    float wetR[SCHEDULER_TICK];
+    float foldedL[SCHEDULER_TICK];
+    float foldedR[SCHEDULER_TICK];
+    float tailL[SCHEDULER_TICK / 2];
+    float tailR[SCHEDULER_TICK / 2];
+
+    // Freeze sustain, applied to the wet output before the width and mix
+    SpectralFreeze freezer;
+
+    // Position within the current scheduler tick
+    size_t tickPos;
+
+    // Samples of the FIR head crossfade done since the last swap
+    size_t firFadePos;
+
+    // FIR head: reversed taps per IR bank and path and the delayed input,
+    // with the last FIR_HEAD_LENGTH - 1 samples of the previous chunk in front
+    float firTaps[IR_BANKS][IR_PATHS][FIR_HEAD_LENGTH];
+    float firInput[2][FIR_HEAD_LENGTH - 1 + SCHEDULER_TICK];
+
+    // Multirate tail decimator: the delayed input with the last tail filter
+    // taps - 1 samples of the previous chunk in front, and the input
+    // samples since the reset modulo the factor
+    float tailInput[2][MAX_TAIL_FILTER_TAPS - 1 + SCHEDULER_TICK];
+    size_t tailPhase;
+
+    // Add the FIR of n samples of x (with history in front) through
+    // reversed taps into out. Four outputs share each tap load.
+    static ECHO_FAST_CODE void FirBlock(const float* taps, const float* x, float* out, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            float acc0 = 0.0f;
+            float acc1 = 0.0f;
+            float acc2 = 0.0f;
+            float acc3 = 0.0f;
+            const float* xi = x + i;
+            for (size_t k = 0; k < FIR_HEAD_LENGTH; k++) {
+                float tap = taps[k];
+                acc0 += tap * xi[k];
+                acc1 += tap * xi[k + 1];
+                acc2 += tap * xi[k + 2];
+                acc3 += tap * xi[k + 3];
+            }
+            out[i] += acc0;
+            out[i + 1] += acc1;
+            out[i + 2] += acc2;
+            out[i + 3] += acc3;
+        }
+        for (; i < n; i++) {
+            float acc = 0.0f;
+            for (size_t k = 0; k < FIR_HEAD_LENGTH; k++) {
+                acc += taps[k] * x[i + k];
+            }
+            out[i] += acc;
+        }
+    }
+
+    // Add the FIR head of one IR bank over n samples of xL/xR into outL/outR
+    ECHO_FAST_CODE void FirHeadBank(size_t bank, const float* xL, const float* xR, bool monoInput,
+                                    float* outL, float* outR, size_t n) {
+        const float (*taps)[FIR_HEAD_LENGTH] = firTaps[bank];
+        IrLayout layout = bankLayout[bank];
+
+        if (layout == IR_LAYOUT_MONO && monoInput) {
+            // One FIR feeds both outputs (the wet rings may still differ)
+            float head[SCHEDULER_TICK];
+            memset(head, 0, n * sizeof(float));
+            FirBlock(taps[IR_PATH_LL], xL, head, n);
+            for (size_t i = 0; i < n; i++) {
+                outL[i] += head[i];
+                outR[i] += head[i];
+            }
+        } else if (layout == IR_LAYOUT_MONO) {
+            FirBlock(taps[IR_PATH_LL], xL, outL, n);
+            FirBlock(taps[IR_PATH_LL], xR, outR, n);
+        } else {
+            FirBlock(taps[IR_PATH_LL], xL, outL, n);
+            FirBlock(taps[IR_PATH_RR], xR, outR, n);
+            if (layout == IR_LAYOUT_TRUE_STEREO) {
+                FirBlock(taps[IR_PATH_RL], xR, outL, n);
+                FirBlock(taps[IR_PATH_LR], xL, outR, n);
+            }
+        }
+    }
+
+    // Chunk scratch of the wet stream a bank plays on
+    void BankWet(size_t bank, float*& outL, float*& outR) {
+        outL = bankFolded[bank] ? foldedL : wetL;
+        outR = bankFolded[bank] ? foldedR : wetR;
+    }
+
+    // Run the FIR head over the delayed input of this chunk into the wet
+    // stream of each bank
+    ECHO_FAST_CODE void ProcessFirHead(size_t n) {
+        const size_t history = FIR_HEAD_LENGTH - 1;
+        bool monoInput = !stereoInput;
+
+        memcpy(firInput[0] + history, delayedL, n * sizeof(float));
+        memcpy(firInput[1] + history, delayedR, n * sizeof(float));
+
+        const float* xL = firInput[0];
+        const float* xR = monoInput ? firInput[0] : firInput[1];
+
+        if (firFadePos < FIR_HEAD_LENGTH) {
+            // After a swap the head crossfades over one section 0 block, on
+            // the same ramp as section 0's fading job
+            float oldL[SCHEDULER_TICK];
+            float oldR[SCHEDULER_TICK];
+            float newL[SCHEDULER_TICK];
+            float newR[SCHEDULER_TICK];
+            memset(oldL, 0, n * sizeof(float));
+            memset(oldR, 0, n * sizeof(float));
+            memset(newL, 0, n * sizeof(float));
+            memset(newR, 0, n * sizeof(float));
+            FirHeadBank(liveBank ^ 1, xL, xR, monoInput, oldL, oldR, n);
+            FirHeadBank(liveBank, xL, xR, monoInput, newL, newR, n);
+
+            float* fromL;
+            float* fromR;
+            float* toL;
+            float* toR;
+            BankWet(liveBank ^ 1, fromL, fromR);
+            BankWet(liveBank, toL, toR);
+
+            const float step = 1.0f / FIR_HEAD_LENGTH;
+            for (size_t i = 0; i < n; i++) {
+                size_t pos = firFadePos + i + 1;
+                float gain = (pos < FIR_HEAD_LENGTH) ? pos * step : 1.0f;
+                fromL[i] += oldL[i] * (1.0f - gain);
+                fromR[i] += oldR[i] * (1.0f - gain);
+                toL[i] += newL[i] * gain;
+                toR[i] += newR[i] * gain;
+            }
+            firFadePos = (firFadePos + n < FIR_HEAD_LENGTH) ? firFadePos + n : FIR_HEAD_LENGTH;
+        } else {
+            float* outL;
+            float* outR;
+            BankWet(liveBank, outL, outR);
+            FirHeadBank(liveBank, xL, xR, monoInput, outL, outR, n);
+        }
+
+        // Keep the newest samples as history for the next chunk
+        memmove(firInput[0], firInput[0] + n, history * sizeof(float));
+        memmove(firInput[1], firInput[1] + n, history * sizeof(float));
+    }
+
+    // Decimate this chunk's delayed input for the multirate tail into
+    // tailL/tailR and return the samples produced. Decimated sample k is
+    // taken when input sample factor * k + factor - 1 arrives. A mono input
+    // is filtered once.
+    ECHO_FAST_CODE size_t DecimateInput(size_t n) {
+        const size_t factor = tailDecimation;
+        const size_t history = 2 * (TAIL_FILTER_SPAN * factor - 1);
+        bool monoInput = !stereoInput;
+
+        memcpy(tailInput[0] + history, delayedL, n * sizeof(float));
+        memcpy(tailInput[1] + history, delayedR, n * sizeof(float));
+
+        size_t count = 0;
+        for (size_t i = factor - 1 - tailPhase; i < n; i += factor) {
+            const float* xL = tailInput[0] + i;
+            const float* xR = tailInput[1] + i;
+            float accL = 0.0f;
+            float accR = 0.0f;
+            if (monoInput) {
+                for (size_t t = 0; t < tailTaps; t++) {
+                    accL += tailDownGain[t] * xL[tailTapOffset[t]];
+                }
+                accR = accL;
+            } else {
+                for (size_t t = 0; t < tailTaps; t++) {
+                    accL += tailDownGain[t] * xL[tailTapOffset[t]];
+                    accR += tailDownGain[t] * xR[tailTapOffset[t]];
+                }
+            }
+            tailL[count] = accL;
+            tailR[count] = accR;
+            count++;
+        }
+        tailPhase = (tailPhase + n) % factor;
+
+        // Keep the newest samples as history for the next chunk
+        memmove(tailInput[0], tailInput[0] + n, history * sizeof(float));
+        memmove(tailInput[1], tailInput[1] + n, history * sizeof(float));
+        return count;
+    }
+
+    // Make the prepared bank live. Each section crossfades into it over its
+    // next block; the first bank after a reset starts without a fade.
+    void SwapBank() {
+        liveBank ^= 1;
+        bool crossfade = wetActive;
+        size_t stream = bankFolded[liveBank] ? WET_FOLDED : WET_FILTERED;
+
+        section0.SelectBank(liveBank, bankLayout[liveBank], stream, crossfade);
+        section1.SelectBank(liveBank, bankLayout[liveBank], stream, crossfade);
+        section2.SelectBank(liveBank, bankLayout[liveBank], stream, crossfade);
+        if (tailDecimation == 2) {
+            tail2.SelectBank(liveBank, bankLayout[liveBank], stream, crossfade);
+        } else if (tailDecimation == 4) {
+            tail4.SelectBank(liveBank, bankLayout[liveBank], stream, crossfade);
+        } else {
+            section3.SelectBank(liveBank, bankLayout[liveBank], stream, crossfade);
+        }
+        firFadePos = (crossfade && zeroLatency) ? 0 : FIR_HEAD_LENGTH;
+
+        wetActive = true;
+        swapState.store(IR_SWAP_FADING, std::memory_order_relaxed);
+    }
+
+    // Copy n samples into a ring buffer starting at pos, wrapping at size
+    static void WriteRing(float* ring, size_t size, size_t pos, const float* src, size_t n) {
+        size_t first = (n < size - pos) ? n : size - pos;
+        memcpy(ring + pos, src, first * sizeof(float));
+        memcpy(ring, src + first, (n - first) * sizeof(float));
+    }
+
+    // Copy n samples out of a ring buffer starting at pos, wrapping at size
+    static void ReadRing(const float* ring, size_t size, size_t pos, float* dst, size_t n) {
+        size_t first = (n < size - pos) ? n : size - pos;
+        memcpy(dst, ring + pos, first * sizeof(float));
+        memcpy(dst + first, ring, (n - first) * sizeof(float));
+    }
+
+    // Move n samples of one wet stream out of its rings into outL/outR,
+    // clearing the ring slots for reuse. A stream no bank has played on
+    // for a whole ring is all zeros and is not touched.
+    ECHO_FAST_CODE void ReadWet(size_t stream, float* ringL, float* ringR, float* outL, float* outR, size_t n) {
+        bool playing = bankFolded[liveBank] == (stream == WET_FOLDED) ||
+                       (swapState.load(std::memory_order_relaxed) == IR_SWAP_FADING &&
+                        bankFolded[liveBank ^ 1] == (stream == WET_FOLDED));
+        if (playing) {
+            wetIdle[stream] = 0;
+        } else if (wetIdle[stream] < WET_RING_SIZE) {
+            wetIdle[stream] += n;
+        } else {
+            memset(outL, 0, n * sizeof(float));
+            memset(outR, 0, n * sizeof(float));
+            return;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            size_t pos = (wetReadPos + i) & WET_RING_MASK;
+            outL[i] = ringL[pos];
+            outR[i] = ringR[pos];
+            ringL[pos] = 0.0f;
+            ringR[pos] = 0.0f;
+        }
+    }
+
+    // Process up to the end of the current scheduler tick
+    ECHO_FAST_CODE void ProcessChunk(const float* inL, const float* inR, float* outL, float* outR, size_t n) {
+        // A bypass fades the reverb's input out, staged in the wet scratch;
+        // what is already in the predelay and the sections still plays
+        float bypassTo = bypassTarget.load(std::memory_order_relaxed) ? 1.0f : 0.0f;
+        if (bypassTo != bypassLevel) {
+            float step = (float)n / BYPASS_FADE;
+            bypassTo = (bypassTo > bypassLevel) ? fminf(bypassLevel + step, 1.0f) : fmaxf(bypassLevel - step, 0.0f);
+        }
+        const float* sendL = inL;
+        const float* sendR = inR;
+        if (bypassLevel != 0.0f || bypassTo != 0.0f) {
+            float bypassStep = (bypassTo - bypassLevel) / n;
+            for (size_t i = 0; i < n; i++) {
+                float send = 1.0f - (bypassLevel + bypassStep * (i + 1));
+                wetL[i] = inL[i] * send;
+                wetR[i] = inR[i] * send;
+            }
+            sendL = wetL;
+            sendR = wetR;
+        }
+
+        // Store input in predelay buffer and get the delayed input
+        WriteRing(g_predelayBuffer, PREDELAY_RING_SIZE, predelayBufferPos, sendL, n);
+        WriteRing(g_predelayBufferRight, PREDELAY_RING_SIZE, predelayBufferPos, sendR, n);
+
+        float gate = gateLevel.load(std::memory_order_relaxed);
+        float inputPeak = (gate > 0.0f) ? Peak(sendL, sendR, n) : 0.0f;
+
+        // A new predelay starts a crossfade from the old tap, which is
+        // staged in the wet scratch before the wet output is read
+        if (predelayFadePos >= PREDELAY_FADE) {
+            size_t delay = predelayTarget.load(std::memory_order_relaxed);
+            if (delay != predelayInSamples) {
+                predelayFadeFrom = predelayInSamples;
+                predelayInSamples = delay;
+                predelayFadePos = 0;
+            }
+        }
+
+        size_t delayedPos = (predelayBufferPos - predelayInSamples) & PREDELAY_RING_MASK;
+        ReadRing(g_predelayBuffer, PREDELAY_RING_SIZE, delayedPos, delayedL, n);
+        ReadRing(g_predelayBufferRight, PREDELAY_RING_SIZE, delayedPos, delayedR, n);
+
+        if (predelayFadePos < PREDELAY_FADE) {
+            size_t oldPos = (predelayBufferPos - predelayFadeFrom) & PREDELAY_RING_MASK;
+            ReadRing(g_predelayBuffer, PREDELAY_RING_SIZE, oldPos, wetL, n);
+            ReadRing(g_predelayBufferRight, PREDELAY_RING_SIZE, oldPos, wetR, n);
+
+            const float step = 1.0f / PREDELAY_FADE;
+            for (size_t i = 0; i < n; i++) {
+                size_t pos = predelayFadePos + i + 1;
+                float gain = (pos < PREDELAY_FADE) ? pos * step : 1.0f;
+                delayedL[i] = wetL[i] + (delayedL[i] - wetL[i]) * gain;
+                delayedR[i] = wetR[i] + (delayedR[i] - wetR[i]) * gain;
+            }
+            predelayFadePos += n;
+        }
+
+        predelayBufferPos = (predelayBufferPos + n) & PREDELAY_RING_MASK;
+        DspLap(DSP_STAGE_PREDELAY);
+
+        // Input, a freeze or an IR swap wakes the gated convolution
+        bool frozen = freezeTarget.load(std::memory_order_relaxed);
+        if (gated && (inputPeak > gate || frozen ||
+                      swapState.load(std::memory_order_relaxed) == IR_SWAP_PENDING)) {
+            gated = false;
+            inputQuiet = 0;
+            wetQuiet = 0;
+        }
+
+        if (gated) {
+            // The cutoffs still glide, so a settled tone knob gets folded
+            GlideFilters(n);
+            memset(wetL, 0, n * sizeof(float));
+            memset(wetR, 0, n * sizeof(float));
+            DspLap(DSP_STAGE_WET);
+        } else {
+            // While the freeze sustain stands alone the convolution is
+            // paused where it was, and picks up from there on release
+            if (frozen && freezer.Suspended()) {
+                memset(wetL, 0, n * sizeof(float));
+                memset(wetR, 0, n * sizeof(float));
+            } else {
+                ConvolveChunk(n);
+            }
+            freezer.Process(wetL, wetR, n, frozen);
+            DspLap(DSP_STAGE_FREEZE);
+
+            if (gate > 0.0f) {
+                UpdateGate(gate, inputPeak, n, frozen);
+            }
+        }
+
+        // Apply stereo width, ramped linearly across the chunk
+        float width = stereoWidthTarget.load(std::memory_order_relaxed);
+        if (stereoWidth != 1.0f || width != 1.0f) {
+            WidthBlock(wetL, wetR, stereoWidth, (width - stereoWidth) / n, n);
+            stereoWidth = width;
+        }
+
+        // Mix dry and wet signals, ramping the gains the same way. Bypassed,
+        // the dry signal is at unity gain over the tail.
+        float mix = dryWetTarget.load(std::memory_order_relaxed);
+        float dryFrom = 1.0f - dryWet * (1.0f - bypassLevel);
+        float dryTo = 1.0f - mix * (1.0f - bypassTo);
+        float dryStep = (dryTo - dryFrom) / n;
+        float mixStep = (mix - dryWet) / n;
+        MixBlock(inL, wetL, outL, dryFrom, dryStep, dryWet, mixStep, n);
+        MixBlock(inR, wetR, outR, dryFrom, dryStep, dryWet, mixStep, n);
+        dryWet = mix;
+        bypassLevel = bypassTo;
+        DspLap(DSP_STAGE_MIX);
+    }
+
+    // Mid/side width over n samples of left/right in place, the side gain
+    // (width) stepping by widthStep per sample from its last value. The
+    // block kernels handle four samples per pass, which -Os does not
+    // unroll, so loads and stores pair with the FPU on the M7.
+    static ECHO_FAST_CODE void WidthBlock(float* left, float* right, float width, float widthStep, size_t n) {
+        size_t i = 0;
+        if (widthStep == 0.0f) {
+            float gain = width * 0.5f;
+            for (; i + 4 <= n; i += 4) {
+                float l0 = left[i], l1 = left[i + 1], l2 = left[i + 2], l3 = left[i + 3];
+                float r0 = right[i], r1 = right[i + 1], r2 = right[i + 2], r3 = right[i + 3];
+                float m0 = (l0 + r0) * 0.5f, m1 = (l1 + r1) * 0.5f, m2 = (l2 + r2) * 0.5f, m3 = (l3 + r3) * 0.5f;
+                float s0 = (l0 - r0) * gain, s1 = (l1 - r1) * gain, s2 = (l2 - r2) * gain, s3 = (l3 - r3) * gain;
+                left[i] = m0 + s0;
+                left[i + 1] = m1 + s1;
+                left[i + 2] = m2 + s2;
+                left[i + 3] = m3 + s3;
+                right[i] = m0 - s0;
+                right[i + 1] = m1 - s1;
+                right[i + 2] = m2 - s2;
+                right[i + 3] = m3 - s3;
+            }
+        }
+        for (; i < n; i++) {
+            float mid = (left[i] + right[i]) * 0.5f;
+            float side = (left[i] - right[i]) * 0.5f * (width + widthStep * (i + 1));
+            left[i] = mid + side;
+            right[i] = mid - side;
+        }
+    }
+
+    // out = in * dry + wet * gain over n samples, both gains stepping per
+    // sample from their last values
+    static ECHO_FAST_CODE void MixBlock(const float* in, const float* wet, float* out,
+                                        float dry, float dryStep, float gain, float gainStep, size_t n) {
+        size_t i = 0;
+        if (dryStep == 0.0f && gainStep == 0.0f) {
+            for (; i + 4 <= n; i += 4) {
+                float a0 = in[i], a1 = in[i + 1], a2 = in[i + 2], a3 = in[i + 3];
+                float b0 = wet[i], b1 = wet[i + 1], b2 = wet[i + 2], b3 = wet[i + 3];
+                out[i] = a0 * dry + b0 * gain;
+                out[i + 1] = a1 * dry + b1 * gain;
+                out[i + 2] = a2 * dry + b2 * gain;
+                out[i + 3] = a3 * dry + b3 * gain;
+            }
+        }
+        for (; i < n; i++) {
+            out[i] = in[i] * (dry + dryStep * (i + 1)) + wet[i] * (gain + gainStep * (i + 1));
+        }
+    }
+
+    // Track how long the reverb's input and the wet output have been below
+    // the gate level, and gate the convolution once both have been quiet
+    // for the hold time, the input for the predelay on top. Frozen or while
+    // an IR swap runs the convolution stays on.
+    void UpdateGate(float gate, float inputPeak, size_t n, bool frozen) {
+        if (inputPeak > gate) {
+            inputQuiet = 0;
+        } else if (inputQuiet < MAX_PREDELAY_SAMPLES + gateHoldSamples) {
+            inputQuiet += n;
+        }
+
+        if (Peak(wetL, wetR, n) > gate) {
+            wetQuiet = 0;
+        } else if (wetQuiet < gateHoldSamples) {
+            wetQuiet += n;
+        }
+
+        gated = inputQuiet >= predelayInSamples + gateHoldSamples && wetQuiet >= gateHoldSamples &&
+                !frozen && swapState.load(std::memory_order_relaxed) == IR_SWAP_IDLE;
+    }
+
+    // Largest magnitude of n samples on either channel
+    static float Peak(const float* left, const float* right, size_t n) {
+        float peak = 0.0f;
+        for (size_t i = 0; i < n; i++) {
+            peak = fmaxf(peak, fmaxf(fabsf(left[i]), fabsf(right[i])));
+        }
+        return peak;
+    }
+
+    // Wet output of the convolution for the chunk into wetL/wetR: read the
+    // wet rings, feed the sections, run the tick's jobs and filter
+    ECHO_FAST_CODE void ConvolveChunk(size_t n) {
+        // Get wet output of both streams
+        ReadWet(WET_FILTERED, g_wetRing, g_wetRingRight, wetL, wetR, n);
+        ReadWet(WET_FOLDED, g_wetRingFolded, g_wetRingFoldedRight, foldedL, foldedR, n);
+        wetReadPos = (wetReadPos + n) & WET_RING_MASK;
+        DspLap(DSP_STAGE_WET);
+
+        // Zero-latency head: the first taps straight from the delayed input
+        if (zeroLatency) {
+            ProcessFirHead(n);
+        }
+        DspLap(DSP_STAGE_FIR_HEAD);
+
+        // Feed the sections
+        bool ready1 = section1.Write(delayedL, delayedR, n);
+        bool ready2 = section2.Write(delayedL, delayedR, n);
+        bool ready3 = false;
+        if (tailDecimation == 1) {
+            ready3 = section3.Write(delayedL, delayedR, n);
+        } else {
+            size_t decimated = DecimateInput(n);
+            ready3 = (tailDecimation == 2) ? tail2.Write(tailL, tailR, decimated)
+                                           : tail4.Write(tailL, tailR, decimated);
+        }
+        section0.Write(delayedL, delayedR, n);
+        DspLap(DSP_STAGE_PREDELAY);
+
+        // On every scheduler tick start the jobs of the blocks that completed
+        // and run each section's share of work
+        tickPos += n;
+        if (tickPos >= SCHEDULER_TICK) {
+            tickPos = 0;
+
+            // A prepared IR bank goes live on the tick boundary
+            if (swapState.load(std::memory_order_acquire) == IR_SWAP_PENDING) {
+                SwapBank();
+            }
+
+            bool monoInput = !stereoInput;
+            size_t latency = zeroLatency ? 0 : WET_LATENCY;
+
+            section0.StartJob(wetReadPos + section0.DepositOffset(latency), monoInput);
+            DspLap(DSP_STAGE_SECTION_0);
+            if (ready1) section1.StartJob(wetReadPos + section1.DepositOffset(latency), monoInput);
+            DspLap(DSP_STAGE_SECTION_1);
+            if (ready2) section2.StartJob(wetReadPos + section2.DepositOffset(latency), monoInput);
+            DspLap(DSP_STAGE_SECTION_2);
+            if (ready3) {
+                if (tailDecimation == 2) {
+                    tail2.StartJob(wetReadPos + tail2.DepositOffset(latency), monoInput);
+                } else if (tailDecimation == 4) {
+                    tail4.StartJob(wetReadPos + tail4.DepositOffset(latency), monoInput);
+                } else {
+                    section3.StartJob(wetReadPos + section3.DepositOffset(latency), monoInput);
+                }
+            }
+            DspLap(DSP_STAGE_SECTION_3);
+
+            float* const rings[WET_STREAMS][2] = {{g_wetRing, g_wetRingRight},
+                                                  {g_wetRingFolded, g_wetRingFoldedRight}};
+            section0.RunTick(rings);
+            DspLap(DSP_STAGE_SECTION_0);
+            section1.RunTick(rings);
+            DspLap(DSP_STAGE_SECTION_1);
+            section2.RunTick(rings);
+            DspLap(DSP_STAGE_SECTION_2);
+            if (tailDecimation == 2) {
+                tail2.RunTick(rings);
+            } else if (tailDecimation == 4) {
+                tail4.RunTick(rings);
+            } else {
+                section3.RunTick(rings);
+            }
+            DspLap(DSP_STAGE_SECTION_3);
+
+            // Hand the old bank back once every section has faded out of it
+            bool lastFading = (tailDecimation == 2) ? tail2.Fading()
+                            : (tailDecimation == 4) ? tail4.Fading()
+                                                    : section3.Fading();
+            if (swapState.load(std::memory_order_relaxed) == IR_SWAP_FADING &&
+                firFadePos >= FIR_HEAD_LENGTH &&
+                !section0.Fading() && !section1.Fading() &&
+                !section2.Fading() && !lastFading) {
+                swapState.store(IR_SWAP_IDLE, std::memory_order_release);
+            }
+        }
+
+        // Glide the cutoffs towards their targets; the coefficients are
+        // only recomputed while one is still moving
+        GlideFilters(n);
+
+        // Apply filters to the unfolded stream while it still carries
+        // signal, then add the stream that has them folded in
+        if (wetIdle[WET_FILTERED] < WET_RING_SIZE) {
+            for (size_t i = 0; i < n; i++) {
+                lowCutFilterL.Process(wetL[i]);
+                highCutFilterL.Process(lowCutFilterL.High());
+                wetL[i] = highCutFilterL.Low();
+
+                lowCutFilterR.Process(wetR[i]);
+                highCutFilterR.Process(lowCutFilterR.High());
+                wetR[i] = highCutFilterR.Low();
+            }
+        }
+        if (wetIdle[WET_FOLDED] < WET_RING_SIZE) {
+            for (size_t i = 0; i < n; i++) {
+                wetL[i] += foldedL[i];
+                wetR[i] += foldedR[i];
+            }
+        }
+        DspLap(DSP_STAGE_WET);
+    }
+
+    // Move both cutoffs a chunk's worth of one-pole glide towards their
+    // targets, snapping once within 0.1%. Once they have rested on the
+    // targets for FOLD_SETTLE_SECONDS the main loop may fold them in.
+    void GlideFilters(size_t n) {
+        float lowTarget = lowCutTarget.load(std::memory_order_relaxed);
+        float highTarget = highCutTarget.load(std::memory_order_relaxed);
+        if (lowCutFreq == lowTarget && highCutFreq == highTarget) {
+            if (toneSettle < toneSettleSamples) {
+                toneSettle += n;
+                if (toneSettle >= toneSettleSamples) {
+                    toneSettled.store(true, std::memory_order_release);
+                }
+            }
+            return;
+        }
+
+        toneSettle = 0;
+        toneSettled.store(false, std::memory_order_relaxed);
+
+        float k = filterSmoothing * n;
+        if (k > 1.0f) k = 1.0f;
+        lowCutFreq += (lowTarget - lowCutFreq) * k;
+        highCutFreq += (highTarget - highCutFreq) * k;
+        if (fabsf(lowTarget - lowCutFreq) < lowTarget * 0.001f) lowCutFreq = lowTarget;
+        if (fabsf(highTarget - highCutFreq) < highTarget * 0.001f) highCutFreq = highTarget;
+        UpdateFilters();
+    }
+};
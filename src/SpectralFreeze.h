@@ -0,0 +1,367 @@
+// Echo Bridge — High-quality convolution reverb for Daisy Seed
+// Copyright (C) 2025  Daniel Ramirez / LUFS Audio
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "daisy_core.h"
+#include "MemoryMap.h"
+#include "shy_fft.h"
+#include <math.h>
+#include <string.h>
+
+// Spectral freeze frames: the last FREEZE_FFT_SIZE wet samples are
+// analysed once, and the sustain is an overlap-add of that spectrum with
+// fresh random phases every FREEZE_HOP samples through a Hann window.
+// Crossfades to and from the sustain take one frame.
+static const size_t FREEZE_FFT_SIZE = 4096;
+static const size_t FREEZE_HOP = FREEZE_FFT_SIZE / 4;
+static const size_t FREEZE_FADE = FREEZE_FFT_SIZE;
+
+// Overlap-add ring: a frame is added one hop ahead of the read position
+static const size_t FREEZE_RING_SIZE = 2 * FREEZE_FFT_SIZE;
+static const size_t FREEZE_RING_MASK = FREEZE_RING_SIZE - 1;
+
+// Phase steps of the random rotations
+static const size_t FREEZE_PHASES = 256;
+
+// Freeze buffers: read and written once per chunk or hop, so they stream
+// well enough from SDRAM
+ECHO_SDRAM_BSS float g_freezeCapture[2][FREEZE_FFT_SIZE];
+ECHO_SDRAM_BSS float g_freezeSpectra[2][FREEZE_FFT_SIZE];
+ECHO_SDRAM_BSS float g_freezeWork[FREEZE_FFT_SIZE];
+ECHO_SDRAM_BSS float g_freezeRing[2][FREEZE_RING_SIZE];
+ECHO_SDRAM_BSS float g_freezeWindow[FREEZE_FFT_SIZE];
+
+// Holds the wet output as an endless, stationary sustain. While live it
+// keeps the last frame of wet output; on freezing that frame is
+// transformed, and once the sustain has taken over the caller may pause
+// the convolution (Suspended()). The work of a frame is split into units
+// like a convolution job and spread over the hop before it plays.
+//
+// Each frame rotates every bin by a random phase, the same one on both
+// channels, so the level and stereo image of the captured sound are kept
+// while its time structure is smeared into a steady pad. A capture with
+// matching channels is synthesized once for both.
+class SpectralFreeze {
+public:
+    static const size_t BINS = ShyFFT<float, FREEZE_FFT_SIZE>::BINS;
+    static const size_t FFT_PASSES = ShyFFT<float, FREEZE_FFT_SIZE>::Passes();
+
+    SpectralFreeze() :
+        state_(FREEZE_LIVE),
+        frozen_(false),
+        mono_(false),
+        capturePos_(0),
+        ringPos_(0),
+        ringLeft_(0),
+        liveGain_(1.0f),
+        fadeDelay_(0),
+        hopPos_(0),
+        jobUnits_(0),
+        jobDone_(0),
+        jobRingPos_(0),
+        seed_(1),
+        frameSeed_(1)
+    {
+    }
+
+    // Build the window and phase tables and clear the buffers
+    void Init() {
+        const float pi = 3.14159265f;
+        for (size_t i = 0; i < FREEZE_FFT_SIZE; i++) {
+            g_freezeWindow[i] = 0.5f - 0.5f * cosf(2.0f * pi * i / FREEZE_FFT_SIZE);
+        }
+        for (size_t i = 0; i < FREEZE_PHASES; i++) {
+            phaseCos_[i] = cosf(2.0f * pi * i / FREEZE_PHASES);
+        }
+        Reset();
+    }
+
+    // Drop the capture and any sustain and return to live output
+    void Reset() {
+        memset(g_freezeCapture, 0, sizeof(g_freezeCapture));
+        memset(g_freezeRing, 0, sizeof(g_freezeRing));
+        state_ = FREEZE_LIVE;
+        frozen_ = false;
+        capturePos_ = 0;
+        ringPos_ = 0;
+        ringLeft_ = 0;
+        liveGain_ = 1.0f;
+        jobUnits_ = 0;
+        jobDone_ = 0;
+    }
+
+    // The sustain has fully replaced the live wet output, which is then
+    // not needed (pass silence) until the freeze is released
+    bool Suspended() const {
+        return state_ == FREEZE_SYNTH && liveGain_ == 0.0f;
+    }
+
+    // Process n wet samples (at most one scheduler tick) in place, following
+    // frozen: captured while live, faded out against the sustain while
+    // frozen and back in on release
+    ECHO_FAST_CODE void Process(float* wetL, float* wetR, size_t n, bool frozen) {
+        // On release the frame in the works is still finished, and the
+        // frames play out through their window. Freezing again before that
+        // keeps the old sustain going.
+        if (frozen != frozen_) {
+            frozen_ = frozen;
+            if (frozen && state_ == FREEZE_LIVE) {
+                StartAnalysis();
+            } else if (!frozen && state_ == FREEZE_ANALYZE) {
+                state_ = FREEZE_LIVE;
+            }
+        }
+
+        if (state_ == FREEZE_LIVE) {
+            Capture(wetL, wetR, n);
+        } else {
+            RunJob(n);
+        }
+
+        // The live output fades out once the first frame plays
+        float target = 1.0f;
+        if (state_ == FREEZE_SYNTH && frozen_) {
+            if (fadeDelay_ > n) {
+                fadeDelay_ -= n;
+            } else {
+                fadeDelay_ = 0;
+                target = 0.0f;
+            }
+        }
+        if (liveGain_ != 1.0f || target != 1.0f) {
+            float step = (float)n / FREEZE_FADE;
+            float gain = (target > liveGain_) ? fminf(liveGain_ + step, 1.0f) : fmaxf(liveGain_ - step, 0.0f);
+            float slope = (gain - liveGain_) / n;
+            for (size_t i = 0; i < n; i++) {
+                float g = liveGain_ + slope * (i + 1);
+                wetL[i] *= g;
+                wetR[i] *= g;
+            }
+            liveGain_ = gain;
+        }
+
+        // Add the sustain and clear the ring behind it
+        if (ringLeft_ > 0) {
+            for (size_t i = 0; i < n; i++) {
+                size_t pos = (ringPos_ + i) & FREEZE_RING_MASK;
+                wetL[i] += g_freezeRing[0][pos];
+                wetR[i] += g_freezeRing[1][pos];
+                g_freezeRing[0][pos] = 0.0f;
+                g_freezeRing[1][pos] = 0.0f;
+            }
+            ringLeft_ = (ringLeft_ > n) ? ringLeft_ - n : 0;
+        }
+        ringPos_ = (ringPos_ + n) & FREEZE_RING_MASK;
+    }
+
+private:
+    enum FreezeState {
+        FREEZE_LIVE,        // Capturing the wet output
+        FREEZE_ANALYZE,     // Transforming the capture
+        FREEZE_SYNTH        // Adding a frame per hop
+    };
+
+    ShyFFT<float, FREEZE_FFT_SIZE> fft_;
+    float phaseCos_[FREEZE_PHASES];
+
+    FreezeState state_;
+    bool frozen_;
+    bool mono_;             // The capture's channels are identical
+    size_t capturePos_;     // Oldest captured sample
+    size_t ringPos_;        // Ring read position
+    size_t ringLeft_;       // Samples from ringPos_ that hold added frames
+    float liveGain_;
+    size_t fadeDelay_;      // Samples until the first frame plays
+
+    // Job of the current hop: analysis, then one frame per hop, spread
+    // over the hop by hopPos_
+    size_t hopPos_;
+    size_t jobUnits_;
+    size_t jobDone_;
+    size_t jobRingPos_;     // Ring position the frame starts at
+    uint32_t seed_;         // Phase generator past the current frame
+    uint32_t frameSeed_;    // Generator at the current frame's first bin
+
+    ECHO_FAST_CODE void Capture(const float* wetL, const float* wetR, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            g_freezeCapture[0][capturePos_] = wetL[i];
+            g_freezeCapture[1][capturePos_] = wetR[i];
+            capturePos_ = (capturePos_ + 1) & (FREEZE_FFT_SIZE - 1);
+        }
+    }
+
+    size_t Channels() const {
+        return mono_ ? 1 : 2;
+    }
+
+    // Per channel, analysis: the windowed copy, the forward passes and the
+    // spectrum split; synthesis: the phase rotation, the spectrum merge,
+    // the permute, the inverse passes and the overlap-add
+    static constexpr size_t AnalysisUnits() {
+        return FFT_PASSES + 3;
+    }
+
+    static constexpr size_t SynthesisUnits() {
+        return FFT_PASSES + 4;
+    }
+
+    // Whether the channels of the capture match to within -100dB of its
+    // peak (a mono reverb's channels differ by rounding)
+    bool CaptureIsMono() const {
+        float peak = 0.0f;
+        float diff = 0.0f;
+        for (size_t i = 0; i < FREEZE_FFT_SIZE; i++) {
+            peak = fmaxf(peak, fabsf(g_freezeCapture[0][i]));
+            diff = fmaxf(diff, fabsf(g_freezeCapture[0][i] - g_freezeCapture[1][i]));
+        }
+        return diff <= peak * 1e-5f;
+    }
+
+    void StartAnalysis() {
+        mono_ = CaptureIsMono();
+        state_ = FREEZE_ANALYZE;
+        hopPos_ = 0;
+        jobUnits_ = Channels() * AnalysisUnits();
+        jobDone_ = 0;
+    }
+
+    // Run the share of the hop's job due after n more samples. A job is
+    // finished at the end of its hop; the analysis is followed by the
+    // first frame, each frame by the next one a hop later until release.
+    ECHO_FAST_CODE void RunJob(size_t n) {
+        size_t before = hopPos_;
+        hopPos_ += n;
+        if (hopPos_ >= FREEZE_HOP) {
+            while (jobDone_ < jobUnits_) {
+                RunUnit();
+            }
+
+            size_t boundary = ringPos_ + FREEZE_HOP - before;
+            hopPos_ -= FREEZE_HOP;
+            if (!frozen_) {
+                state_ = FREEZE_LIVE;
+                return;
+            }
+            if (state_ == FREEZE_ANALYZE) {
+                state_ = FREEZE_SYNTH;
+                fadeDelay_ = FREEZE_HOP + (FREEZE_HOP - before);
+            }
+            frameSeed_ = seed_;
+            jobRingPos_ = (boundary + FREEZE_HOP) & FREEZE_RING_MASK;
+            jobUnits_ = Channels() * SynthesisUnits();
+            jobDone_ = 0;
+        }
+
+        size_t target = (jobUnits_ * hopPos_ + FREEZE_HOP - 1) / FREEZE_HOP;
+        while (jobDone_ < target && jobDone_ < jobUnits_) {
+            RunUnit();
+        }
+    }
+
+    ECHO_FAST_CODE void RunUnit() {
+        size_t unit = jobDone_++;
+        float* re = g_freezeWork;
+        float* im = g_freezeWork + BINS;
+
+        if (state_ == FREEZE_ANALYZE) {
+            size_t ch = unit / AnalysisUnits();
+            size_t step = unit % AnalysisUnits();
+            float* specRe = g_freezeSpectra[ch];
+
+            if (step == 0) {
+                for (size_t i = 0; i < FREEZE_FFT_SIZE; i++) {
+                    size_t pos = (capturePos_ + i) & (FREEZE_FFT_SIZE - 1);
+                    g_freezeWork[i] = g_freezeCapture[ch][pos] * g_freezeWindow[i];
+                }
+            } else if (step == 1) {
+                fft_.PackPermute(g_freezeWork, specRe, specRe + BINS);
+            } else if (step < FFT_PASSES + 2) {
+                fft_.Pass(specRe, specRe + BINS, step - 2);
+            } else {
+                fft_.SplitSpectrum(specRe, specRe + BINS);
+            }
+            return;
+        }
+
+        size_t ch = unit / SynthesisUnits();
+        size_t step = unit % SynthesisUnits();
+        if (step == 0) {
+            Rotate(ch);
+        } else if (step == 1) {
+            fft_.MergeSpectrum(re, im);
+        } else if (step == 2) {
+            fft_.PermuteInPlace(re, im);
+        } else if (step < FFT_PASSES + 3) {
+            fft_.Pass(re, im, step - 3);
+        } else {
+            OverlapAdd(ch);
+        }
+    }
+
+    // Spectrum of channel ch with every bin but DC and Nyquist rotated by
+    // the frame's random phases, into the work buffer
+    ECHO_FAST_CODE void Rotate(size_t ch) {
+        const float* specRe = g_freezeSpectra[ch];
+        const float* specIm = specRe + BINS;
+        float* re = g_freezeWork;
+        float* im = g_freezeWork + BINS;
+
+        re[0] = specRe[0];
+        im[0] = specIm[0];
+        uint32_t seed = frameSeed_;
+        for (size_t k = 1; k < BINS; k++) {
+            seed = seed * 1664525u + 1013904223u;
+            size_t phase = seed >> 24;
+            float c = phaseCos_[phase];
+            float s = phaseCos_[(phase + 3 * FREEZE_PHASES / 4) & (FREEZE_PHASES - 1)];
+            re[k] = specRe[k] * c - specIm[k] * s;
+            im[k] = specRe[k] * s + specIm[k] * c;
+        }
+        seed_ = seed;
+    }
+
+    // Window the inverse transform into the ring from the frame's start.
+    // With random phases the frames add in power: the analysis and
+    // synthesis windows together keep 9/16 of it at a quarter-frame hop,
+    // which the 4/3 gain makes up. A mono frame goes to both channels.
+    ECHO_FAST_CODE void OverlapAdd(size_t ch) {
+        const float gain = 4.0f / 3.0f / FREEZE_FFT_SIZE;
+        const float* re = g_freezeWork;
+        const float* im = g_freezeWork + BINS;
+        float* ring = g_freezeRing[ch];
+        float* copy = g_freezeRing[mono_ ? 1 : ch];
+
+        for (size_t k = 0; k < BINS; k++) {
+            size_t even = (jobRingPos_ + 2 * k) & FREEZE_RING_MASK;
+            size_t odd = (even + 1) & FREEZE_RING_MASK;
+            float a = re[k] * g_freezeWindow[2 * k] * gain;
+            float b = -im[k] * g_freezeWindow[2 * k + 1] * gain;
+            ring[even] += a;
+            ring[odd] += b;
+            if (copy != ring) {
+                copy[even] += a;
+                copy[odd] += b;
+            }
+        }
+
+        size_t left = ((jobRingPos_ - ringPos_) & FREEZE_RING_MASK) + FREEZE_FFT_SIZE;
+        if (left > ringLeft_) {
+            ringLeft_ = left;
+        }
+    }
+};
@@ -0,0 +1,232 @@
+// Echo Bridge — High-quality convolution reverb for Daisy Seed
+// Copyright (C) 2025  Daniel Ramirez / LUFS Audio
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+
+#include "daisy_seed.h"
+#include "MemoryMap.h"
+#include <string.h>
+
+// Raw read chunk shared by all WAV decoding. Samples are converted from here
+// straight into the caller's float buffers, so decoding needs no buffer
+// the size of the file. AXI SRAM, since the USB stack may DMA into it.
+static const size_t WAV_READ_CHUNK = 8192;
+ECHO_AXI_BSS uint8_t g_wavReadChunk[WAV_READ_CHUNK];
+
+// Streaming WAV reader on a FatFs file. Open() walks the RIFF chunks up to
+// the sample data, skipping anything that is not "fmt " or "data" (LIST,
+// bext, fact, ...). Supported: PCM 16/24/32-bit, IEEE float 32/64-bit, and
+// both as WAVE_FORMAT_EXTENSIBLE.
+class WavReader {
+public:
+    enum SampleFormat {
+        FORMAT_PCM = 1,
+        FORMAT_FLOAT = 3,
+        FORMAT_EXTENSIBLE = 0xFFFE
+    };
+
+    WavReader() :
+        file_(nullptr),
+        format_(0),
+        channels_(0),
+        sampleRate_(0),
+        bitsPerSample_(0),
+        blockAlign_(0),
+        frames_(0)
+    {
+    }
+
+    // Parse the header chunks; on success the file is positioned at the
+    // first sample frame
+    bool Open(FIL* file) {
+        file_ = file;
+        frames_ = 0;
+
+        uint8_t riff[12];
+        if (!ReadBytes(riff, sizeof(riff)) ||
+            memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+            return false;
+        }
+
+        bool haveFormat = false;
+        while (true) {
+            uint8_t chunk[8];
+            if (!ReadBytes(chunk, sizeof(chunk))) {
+                return false;
+            }
+            uint32_t size = Le32(chunk + 4);
+
+            if (memcmp(chunk, "data", 4) == 0) {
+                if (!haveFormat) {
+                    return false;
+                }
+
+                // Writers that stream may leave the size unset; never read
+                // past the end of the file
+                FSIZE_t left = f_size(file_) - f_tell(file_);
+                if (size > left) {
+                    size = (uint32_t)left;
+                }
+                frames_ = size / blockAlign_;
+                return true;
+            }
+
+            uint32_t skip = size + (size & 1); // Chunks are padded to even sizes
+            if (memcmp(chunk, "fmt ", 4) == 0) {
+                uint8_t fmt[40];
+                uint32_t count = (size < sizeof(fmt)) ? size : (uint32_t)sizeof(fmt);
+                if (count < 16 || !ReadBytes(fmt, count) || !ParseFormat(fmt, count)) {
+                    return false;
+                }
+                haveFormat = true;
+                skip -= count;
+            }
+
+            if (f_lseek(file_, f_tell(file_) + skip) != FR_OK) {
+                return false;
+            }
+        }
+    }
+
+    uint16_t Channels() const { return channels_; }
+    uint32_t SampleRate() const { return sampleRate_; }
+    uint32_t Frames() const { return frames_; }
+
+    // Frames that fit in one read chunk; reads of up to this many frames
+    // cost a single f_read
+    uint32_t ChunkFrames() const { return WAV_READ_CHUNK / blockAlign_; }
+
+    // Decode the next frames frames. Channel firstChannel + c goes to
+    // outs[c] for count channels.
+    bool Read(float* const* outs, uint16_t firstChannel, uint16_t count, uint32_t frames) {
+        if (firstChannel + count > channels_) {
+            return false;
+        }
+        return Decode(outs, firstChannel, count, frames, false);
+    }
+
+    // Decode the next frames frames as the average of all channels
+    bool ReadMixed(float* out, uint32_t frames) {
+        return Decode(&out, 0, 1, frames, true);
+    }
+
+private:
+    FIL* file_;
+    uint16_t format_;
+    uint16_t channels_;
+    uint32_t sampleRate_;
+    uint16_t bitsPerSample_;
+    uint16_t blockAlign_;
+    uint32_t frames_;
+
+    static uint16_t Le16(const uint8_t* p) {
+        return (uint16_t)(p[0] | (p[1] << 8));
+    }
+
+    static uint32_t Le32(const uint8_t* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    bool ReadBytes(void* data, UINT bytes) {
+        UINT bytesRead;
+        return f_read(file_, data, bytes, &bytesRead) == FR_OK && bytesRead == bytes;
+    }
+
+    bool ParseFormat(const uint8_t* fmt, uint32_t size) {
+        format_ = Le16(fmt);
+        channels_ = Le16(fmt + 2);
+        sampleRate_ = Le32(fmt + 4);
+        blockAlign_ = Le16(fmt + 12);
+        bitsPerSample_ = Le16(fmt + 14);
+
+        // The real format code is the start of the SubFormat GUID
+        if (format_ == FORMAT_EXTENSIBLE) {
+            if (size < 40) {
+                return false;
+            }
+            format_ = Le16(fmt + 24);
+        }
+
+        bool supported = (format_ == FORMAT_PCM &&
+                          (bitsPerSample_ == 16 || bitsPerSample_ == 24 || bitsPerSample_ == 32)) ||
+                         (format_ == FORMAT_FLOAT && (bitsPerSample_ == 32 || bitsPerSample_ == 64));
+
+        return supported && channels_ > 0 &&
+               blockAlign_ == channels_ * (bitsPerSample_ / 8) && blockAlign_ <= WAV_READ_CHUNK;
+    }
+
+    float Sample(const uint8_t* src) const {
+        if (format_ == FORMAT_FLOAT) {
+            if (bitsPerSample_ == 64) {
+                double value;
+                memcpy(&value, src, sizeof(value));
+                return (float)value;
+            }
+            float value;
+            memcpy(&value, src, sizeof(value));
+            return value;
+        }
+
+        if (bitsPerSample_ == 16) {
+            return (float)(int16_t)Le16(src) / 32768.0f;
+        }
+        if (bitsPerSample_ == 24) {
+            int32_t sample = (int32_t)(((uint32_t)src[0] << 8) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 24));
+            return (float)(sample >> 8) / 8388608.0f;
+        }
+        return (float)(int32_t)Le32(src) / 2147483648.0f;
+    }
+
+    // Read frames through the chunk buffer and convert them
+    bool Decode(float* const* outs, uint16_t firstChannel, uint16_t count, uint32_t frames, bool mix) {
+        size_t bytesPerSample = bitsPerSample_ / 8;
+        uint32_t chunkFrames = WAV_READ_CHUNK / blockAlign_;
+        float mixScale = 1.0f / channels_;
+
+        for (uint32_t start = 0; start < frames; start += chunkFrames) {
+            uint32_t n = frames - start;
+            if (n > chunkFrames) n = chunkFrames;
+
+            if (!ReadBytes(g_wavReadChunk, n * blockAlign_)) {
+                return false;
+            }
+
+            if (mix) {
+                const uint8_t* src = g_wavReadChunk;
+                float* dst = outs[0] + start;
+                for (uint32_t i = 0; i < n; i++) {
+                    float sum = 0.0f;
+                    for (uint16_t c = 0; c < channels_; c++, src += bytesPerSample) {
+                        sum += Sample(src);
+                    }
+                    dst[i] = sum * mixScale;
+                }
+                continue;
+            }
+
+            for (uint16_t c = 0; c < count; c++) {
+                const uint8_t* src = g_wavReadChunk + (firstChannel + c) * bytesPerSample;
+                float* dst = outs[c] + start;
+                for (uint32_t i = 0; i < n; i++, src += blockAlign_) {
+                    dst[i] = Sample(src);
+                }
+            }
+        }
+
+        return true;
+    }
+};
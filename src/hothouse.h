@@ -21,6 +21,8 @@
 #include "dev/oled_ssd130x.h"
 #include "hid/encoder.h"
 #include "hid/switch.h"
+#include "per/tim.h"
+#include <atomic>
 
 namespace clevelandmusicco {
 
@@ -56,17 +58,26 @@ public:
         OLED_RESET = 4  // D4
     };
     
+    // Controls are scanned at a fixed rate from a timer interrupt, so the
+    // knob smoothing (a one-pole with a time constant of about 10ms) and
+    // the debouncing no longer depend on how fast the main loop spins
+    static const uint32_t CONTROL_SCAN_RATE = 1000; // Hz
+    static constexpr float KNOB_SMOOTHING = 0.1f;   // Per scan
+    
     Hothouse() {}
     
-    void Init() {
+    // Initialize the hardware with the audio block size (samples per
+    // callback) and sample rate
+    void Init(size_t blockSize = 48,
+              daisy::SaiHandle::Config::SampleRate sampleRate = daisy::SaiHandle::Config::SampleRate::SAI_48KHZ) {
         // Initialize seed hardware
         seed.Configure();
         seed.Init();
         
         // Initialize audio - use public API
         daisy::AudioHandle::Config audio_config;
-        audio_config.samplerate = daisy::SaiHandle::Config::SampleRate::SAI_48KHZ;
-        audio_config.blocksize = 48;
+        audio_config.samplerate = sampleRate;
+        audio_config.blocksize = blockSize;
         seed.SetAudioBlockSize(audio_config.blocksize);
         seed.SetAudioSampleRate(audio_config.samplerate);
         
@@ -95,33 +106,40 @@ public:
         for (int i = 0; i < 3; i++) {
             toggles_[i].Init(seed.GetPin(GetTogglePin(i)), 1000);
             toggleStates_[i] = 0;
+            togglePressed_[i] = false;
             toggleCallbacks_[i] = nullptr;
         }
+        
+        // Start the control scan
+        daisy::TimerHandle::Config timerConfig;
+        timerConfig.periph = daisy::TimerHandle::Config::Peripheral::TIM_5;
+        timerConfig.enable_irq = true;
+        scanTimer_.Init(timerConfig);
+        scanTimer_.SetPeriod(scanTimer_.GetFreq() / CONTROL_SCAN_RATE - 1);
+        scanTimer_.SetCallback(ScanControls, this);
+        scanTimer_.Start();
     }
     
+    // Dispatch what the control scan recorded since the last call to the
+    // callbacks. Runs in the main loop, so the callbacks may do real work.
     void ProcessAllControls() {
-        // Process ADC readings
+        // Knob values
         for (int i = 0; i < 6; i++) {
-            float newValue = seed.adc.GetFloat(i);
-            
-            // Apply some smoothing
-            adcValues_[i] = adcValues_[i] * 0.9f + newValue * 0.1f;
+            float value = adcValues_[i];
             
             // Call callback if value changed significantly
-            if (knobCallbacks_[i] != nullptr && fabsf(adcValues_[i] - lastKnobValues_[i]) > 0.01f) {
-                knobCallbacks_[i](adcValues_[i]);
-                lastKnobValues_[i] = adcValues_[i];
+            if (knobCallbacks_[i] != nullptr && fabsf(value - lastKnobValues_[i]) > 0.01f) {
+                knobCallbacks_[i](value);
+                lastKnobValues_[i] = value;
             }
         }
         
-        // Process footswitches
+        // Footswitch edges
+        uint32_t events = scanEvents_.exchange(0, std::memory_order_acquire);
         for (int i = 0; i < 2; i++) {
-            footswitches_[i].Debounce();
-            
             // Check for press
-            if (footswitches_[i].RisingEdge()) {
+            if (events & (FOOTSWITCH_PRESSED << (2 * i))) {
                 footswitchStates_[i] = true;
-                footswitchPressTime_[i] = daisy::System::GetNow();
                 
                 // Call callback
                 if (footswitchCallbacks_[i] != nullptr) {
@@ -130,12 +148,11 @@ public:
             }
             
             // Check for release
-            if (footswitches_[i].FallingEdge()) {
+            if (events & (FOOTSWITCH_RELEASED << (2 * i))) {
                 footswitchStates_[i] = false;
                 
                 // Check for long press
-                uint32_t pressDuration = daisy::System::GetNow() - footswitchPressTime_[i];
-                if (pressDuration > 1000 && footswitchLongPressCallbacks_[i] != nullptr) {
+                if (footswitchPressDuration_[i] > 1000 && footswitchLongPressCallbacks_[i] != nullptr) {
                     footswitchLongPressCallbacks_[i]();
                 }
                 
@@ -146,12 +163,10 @@ public:
             }
         }
         
-        // Process toggles
+        // Toggle states
         for (int i = 0; i < 3; i++) {
-            toggles_[i].Debounce();
-            
             // Check for state change
-            int newState = toggles_[i].Pressed() ? 1 : -1;
+            int newState = togglePressed_[i] ? 1 : -1;
             
             if (newState != toggleStates_[i]) {
                 toggleStates_[i] = newState;
@@ -233,18 +248,62 @@ public:
     daisy::DaisySeed seed;
     
 private:
+    // Footswitch edge bits in scanEvents_, two per footswitch
+    static const uint32_t FOOTSWITCH_PRESSED = 1;
+    static const uint32_t FOOTSWITCH_RELEASED = 2;
+    
+    // Written by the control scan, read by ProcessAllControls()
+    daisy::TimerHandle scanTimer_;
+    std::atomic<uint32_t> scanEvents_{0};
+    
     // ADC values for knobs
-    float adcValues_[6];
+    volatile float adcValues_[6];
     float lastKnobValues_[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
     
     // Footswitches
     daisy::Switch footswitches_[2];
     bool footswitchStates_[2];
     uint32_t footswitchPressTime_[2];
+    volatile uint32_t footswitchPressDuration_[2]; // Of the last release
     
     // Toggles
     daisy::Switch toggles_[3];
     int toggleStates_[3];
+    volatile bool togglePressed_[3];
+    
+    static void ScanControls(void* data) {
+        static_cast<Hothouse*>(data)->Scan();
+    }
+    
+    // Timer interrupt: smooth the knobs, debounce the switches and record
+    // footswitch edges. No callbacks run here.
+    void Scan() {
+        for (int i = 0; i < 6; i++) {
+            adcValues_[i] = adcValues_[i] + (seed.adc.GetFloat(i) - adcValues_[i]) * KNOB_SMOOTHING;
+        }
+        
+        uint32_t events = 0;
+        uint32_t now = daisy::System::GetNow();
+        for (int i = 0; i < 2; i++) {
+            footswitches_[i].Debounce();
+            if (footswitches_[i].RisingEdge()) {
+                footswitchPressTime_[i] = now;
+                events |= FOOTSWITCH_PRESSED << (2 * i);
+            }
+            if (footswitches_[i].FallingEdge()) {
+                footswitchPressDuration_[i] = now - footswitchPressTime_[i];
+                events |= FOOTSWITCH_RELEASED << (2 * i);
+            }
+        }
+        if (events) {
+            scanEvents_.fetch_or(events, std::memory_order_release);
+        }
+        
+        for (int i = 0; i < 3; i++) {
+            toggles_[i].Debounce();
+            togglePressed_[i] = toggles_[i].Pressed();
+        }
+    }
     
     // Callbacks
     void (*knobCallbacks_[6])(float);
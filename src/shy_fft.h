@@ -19,139 +19,313 @@
 
 // ShyFFT - A simple FFT implementation for embedded systems
 // Based on Cooley-Tukey FFT algorithm
+//
+// ShyFFT<T, N> is an N-point real-input FFT. The N real samples are packed
+// into an N/2-point complex transform, and a post-twiddle pass splits the
+// result into the N/2+1 bins of the real spectrum. Spectra are stored as
+// N/2 real and N/2 imaginary values, with the Nyquist bin (which is purely
+// real, like DC) packed into imag[0].
+//
+// All sizes share one quarter-wave cosine table generated at compile time
+// and stored in flash, sized for the largest transform in the build. Bit
+// reversal uses the RBIT instruction, so no per-size tables are built at
+// boot. The butterflies run as radix-2^2 passes (two radix-2 stages fused),
+// with one leading radix-2 pass when the number of stages is odd.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest transform size in the build; sets the shared twiddle table size
+#ifndef SHY_FFT_MAX_SIZE
+#define SHY_FFT_MAX_SIZE 8192
+#endif
+
+// Optional section attribute for the per-block kernels (e.g. RAM code)
+#ifndef SHY_FFT_FAST_CODE
+#define SHY_FFT_FAST_CODE
+#endif
+
+namespace shy_fft_detail {
+
+constexpr size_t Log2(size_t n) {
+    return (n > 1) ? 1 + Log2(n >> 1) : 0;
+}
+
+// Taylor series cosine, only used to build the table at compile time
+constexpr double Cos(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int n = 1; n < 30; n++) {
+        term *= -x * x / ((2 * n - 1) * (2 * n));
+        sum += term;
+    }
+    return sum;
+}
+
+// cos(2 * pi * k / SHY_FFT_MAX_SIZE) for k = 0 .. SHY_FFT_MAX_SIZE / 4
+template <typename T>
+struct CosineTable {
+    static const size_t QUARTER = SHY_FFT_MAX_SIZE / 4;
+    T value[QUARTER + 1];
+};
+
+template <typename T>
+constexpr CosineTable<T> MakeCosineTable() {
+    CosineTable<T> table{};
+    for (size_t k = 0; k <= CosineTable<T>::QUARTER; k++) {
+        table.value[k] = T(Cos(6.283185307179586476925 * k / SHY_FFT_MAX_SIZE));
+    }
+    return table;
+}
 
-#include <cmath>
-#include <complex>
+template <typename T>
+struct Tables {
+    static constexpr CosineTable<T> cosine = MakeCosineTable<T>();
+};
+
+template <typename T>
+constexpr CosineTable<T> Tables<T>::cosine;
+
+// Reverse the low bits of index
+inline size_t BitReverse(size_t index, size_t bits) {
+#if defined(__arm__)
+    uint32_t result;
+    __asm__("rbit %0, %1" : "=r"(result) : "r"((uint32_t)index));
+    return result >> (32 - bits);
+#else
+    uint32_t result = (uint32_t)index;
+    result = ((result >> 1) & 0x55555555u) | ((result & 0x55555555u) << 1);
+    result = ((result >> 2) & 0x33333333u) | ((result & 0x33333333u) << 2);
+    result = ((result >> 4) & 0x0F0F0F0Fu) | ((result & 0x0F0F0F0Fu) << 4);
+    result = ((result >> 8) & 0x00FF00FFu) | ((result & 0x00FF00FFu) << 8);
+    result = (result >> 16) | (result << 16);
+    return result >> (32 - bits);
+#endif
+}
+
+} // namespace shy_fft_detail
 
 template <typename T, size_t N>
 class ShyFFT {
 public:
-    ShyFFT() {
-        // Precompute twiddle factors
-        for (size_t i = 0; i < N / 2; i++) {
-            T angle = -2.0 * M_PI * i / N;
-            twiddles_real_[i] = cos(angle);
-            twiddles_imag_[i] = sin(angle);
+    static_assert(N >= 4 && (N & (N - 1)) == 0, "FFT size must be a power of two");
+    static_assert(N <= SHY_FFT_MAX_SIZE, "FFT size exceeds SHY_FFT_MAX_SIZE");
+
+    // Number of packed spectrum bins
+    static const size_t BINS = N / 2;
+    
+    // Direct FFT (N real samples to BINS packed bins)
+    void Direct(const T* input, T* real, T* imag) {
+        PackPermute(input, real, imag);
+        
+        for (size_t pass = 0; pass < Passes(); pass++) {
+            Pass(real, imag, pass);
         }
+        
+        SplitSpectrum(real, imag);
     }
     
-    void Init() {
-        // Precompute bit-reversed indices
-        for (size_t i = 0; i < N; i++) {
-            bit_reverse_[i] = BitReverse(i, log2N());
+    // Inverse FFT (BINS packed bins to N real samples, scaled by 1/N).
+    // Runs in place: real and imag are used as workspace and are overwritten.
+    void Inverse(T* real, T* imag, T* output) {
+        MergeSpectrum(real, imag);
+        PermuteInPlace(real, imag);
+        
+        for (size_t pass = 0; pass < Passes(); pass++) {
+            Pass(real, imag, pass);
+        }
+        
+        // The passes produced the conjugate; even samples are in the real
+        // part and odd samples in the (negated) imaginary part
+        T scale = T(1) / N;
+        for (size_t i = 0; i < BINS; i++) {
+            output[2 * i] = real[i] * scale;
+            output[2 * i + 1] = -imag[i] * scale;
         }
     }
     
-    // Direct FFT (time domain to frequency domain)
-    void Direct(const T* input, T* output) {
-        // Copy input to output with bit reversal
-        for (size_t i = 0; i < N; i++) {
-            output[i] = input[bit_reverse_[i]];
+    // Stepwise transform, so callers can spread one FFT over several calls.
+    // Forward: PackPermute(), Pass() for pass = 0..Passes()-1, SplitSpectrum().
+    // Inverse: MergeSpectrum(), PermuteInPlace(), the same passes; sample 2i
+    // is then real[i] / N and sample 2i+1 is -imag[i] / N.
+    
+    // Radix-2 stages of the half-size complex transform
+    static constexpr size_t Stages() {
+        return shy_fft_detail::Log2(BINS);
+    }
+    
+    // Butterfly passes: the stages fused in pairs, plus a leading radix-2
+    // pass when the stage count is odd
+    static constexpr size_t Passes() {
+        return (Stages() + 1) / 2;
+    }
+    
+    // Pack even/odd input samples into real/imag, in bit-reversed order
+    SHY_FFT_FAST_CODE void PackPermute(const T* input, T* real, T* imag) {
+        for (size_t i = 0; i < BINS; i++) {
+            size_t j = shy_fft_detail::BitReverse(i, Stages());
+            real[i] = input[2 * j];
+            imag[i] = input[2 * j + 1];
         }
-        
-        // Perform FFT
-        for (size_t stage = 1; stage <= log2N(); stage++) {
-            size_t m = 1 << stage;
-            size_t m2 = m >> 1;
-            
-            for (size_t k = 0; k < N; k += m) {
-                for (size_t j = 0; j < m2; j++) {
-                    size_t i1 = k + j;
-                    size_t i2 = i1 + m2;
-                    
-                    T re = output[i2] * twiddles_real_[j * N / m] - 0 * twiddles_imag_[j * N / m];
-                    T im = output[i2] * twiddles_imag_[j * N / m] + 0 * twiddles_real_[j * N / m];
-                    
-                    output[i2] = output[i1] - re;
-                    output[i1] = output[i1] + re;
-                }
+    }
+    
+    // Reorder real/imag into bit-reversed order by swapping index pairs
+    SHY_FFT_FAST_CODE void PermuteInPlace(T* real, T* imag) {
+        for (size_t i = 1; i < BINS - 1; i++) {
+            size_t j = shy_fft_detail::BitReverse(i, Stages());
+            if (i < j) {
+                T re = real[i];
+                T im = imag[i];
+                real[i] = real[j];
+                imag[i] = imag[j];
+                real[j] = re;
+                imag[j] = im;
             }
         }
     }
     
-    // Inverse FFT (frequency domain to time domain)
-    void Inverse(T* real, T* imag, size_t size) {
-        // Perform complex conjugate
-        for (size_t i = 0; i < size; i++) {
-            imag[i] = -imag[i];
+    // One in-place butterfly pass (0-based) of the half-size transform
+    SHY_FFT_FAST_CODE void Pass(T* real, T* imag, size_t pass) {
+        const size_t odd = Stages() & 1;
+        
+        if (odd && pass == 0) {
+            // Radix-2 stage with a unit twiddle
+            for (size_t i = 0; i < BINS; i += 2) {
+                T re = real[i + 1];
+                T im = imag[i + 1];
+                real[i + 1] = real[i] - re;
+                imag[i + 1] = imag[i] - im;
+                real[i] += re;
+                imag[i] += im;
+            }
+            return;
         }
         
-        // Perform FFT
-        Complex(real, imag, size);
+        // Radix-2^2: stages s and s+1, butterfly span h = 2^(s-1)
+        size_t s = 2 * pass - odd + 1;
+        size_t h = (size_t)1 << (s - 1);
+        
+        // W_4h^j in units of the shared table
+        size_t shift = TABLE_BITS - s - 1;
         
-        // Scale output
-        T scale = 1.0 / size;
-        for (size_t i = 0; i < size; i++) {
-            real[i] *= scale;
-            imag[i] *= scale;
+        for (size_t j = 0; j < h; j++) {
+            T w1r, w1i;
+            Twiddle(j << shift, w1r, w1i);
+            
+            // W_2h^j = (W_4h^j)^2
+            T w2r = w1r * w1r - w1i * w1i;
+            T w2i = 2 * w1r * w1i;
+            
+            for (size_t k = j; k < BINS; k += 4 * h) {
+                size_t a = k;
+                size_t b = a + h;
+                size_t c = b + h;
+                size_t d = c + h;
+                
+                // First stage: (a, b) and (c, d) with W_2h^j
+                T br = real[b] * w2r - imag[b] * w2i;
+                T bi = real[b] * w2i + imag[b] * w2r;
+                T dr = real[d] * w2r - imag[d] * w2i;
+                T di = real[d] * w2i + imag[d] * w2r;
+                
+                T a1r = real[a] + br;
+                T a1i = imag[a] + bi;
+                T b1r = real[a] - br;
+                T b1i = imag[a] - bi;
+                T c1r = real[c] + dr;
+                T c1i = imag[c] + di;
+                T d1r = real[c] - dr;
+                T d1i = imag[c] - di;
+                
+                // Second stage: (a, c) with W_4h^j and (b, d) with -i W_4h^j
+                T cr = c1r * w1r - c1i * w1i;
+                T ci = c1r * w1i + c1i * w1r;
+                T er = d1r * w1i + d1i * w1r;
+                T ei = d1i * w1i - d1r * w1r;
+                
+                real[a] = a1r + cr;
+                imag[a] = a1i + ci;
+                real[c] = a1r - cr;
+                imag[c] = a1i - ci;
+                real[b] = b1r + er;
+                imag[b] = b1i + ei;
+                real[d] = b1r - er;
+                imag[d] = b1i - ei;
+            }
         }
     }
     
-    // Complex FFT (frequency domain to frequency domain)
-    void Complex(T* real, T* imag, size_t size) {
-        // Copy input to temporary buffer with bit reversal
-        T temp_real[N];
-        T temp_imag[N];
+    // Post-twiddle: turn the half-size complex transform of the packed input
+    // into the packed real spectrum, in place
+    SHY_FFT_FAST_CODE void SplitSpectrum(T* real, T* imag) {
+        T dc = real[0] + imag[0];
+        T nyquist = real[0] - imag[0];
+        real[0] = dc;
+        imag[0] = nyquist;
         
-        for (size_t i = 0; i < size; i++) {
-            temp_real[bit_reverse_[i]] = real[i];
-            temp_imag[bit_reverse_[i]] = imag[i];
-        }
-        
-        // Perform FFT
-        for (size_t stage = 1; stage <= log2N(); stage++) {
-            size_t m = 1 << stage;
-            size_t m2 = m >> 1;
+        for (size_t k = 1; k <= BINS / 2; k++) {
+            size_t k2 = BINS - k;
             
-            for (size_t k = 0; k < size; k += m) {
-                for (size_t j = 0; j < m2; j++) {
-                    size_t i1 = k + j;
-                    size_t i2 = i1 + m2;
-                    
-                    T re = temp_real[i2] * twiddles_real_[j * N / m] - temp_imag[i2] * twiddles_imag_[j * N / m];
-                    T im = temp_real[i2] * twiddles_imag_[j * N / m] + temp_imag[i2] * twiddles_real_[j * N / m];
-                    
-                    temp_real[i2] = temp_real[i1] - re;
-                    temp_imag[i2] = temp_imag[i1] - im;
-                    temp_real[i1] = temp_real[i1] + re;
-                    temp_imag[i1] = temp_imag[i1] + im;
-                }
-            }
+            // Even and odd sample spectra
+            T er = (real[k] + real[k2]) * T(0.5);
+            T ei = (imag[k] - imag[k2]) * T(0.5);
+            T orr = (imag[k] + imag[k2]) * T(0.5);
+            T oi = (real[k2] - real[k]) * T(0.5);
+            
+            T wr, wi;
+            Twiddle(k << SIZE_SHIFT, wr, wi);
+            T tr = wr * orr - wi * oi;
+            T ti = wr * oi + wi * orr;
+            
+            real[k] = er + tr;
+            imag[k] = ei + ti;
+            real[k2] = er - tr;
+            imag[k2] = ti - ei;
         }
+    }
+    
+    // Pre-twiddle: turn a packed real spectrum back into the half-size
+    // complex spectrum of the packed signal (scaled by 2), in place. The
+    // result is conjugated so the forward passes compute the inverse.
+    SHY_FFT_FAST_CODE void MergeSpectrum(T* real, T* imag) {
+        T dc = real[0];
+        T nyquist = imag[0];
+        real[0] = dc + nyquist;
+        imag[0] = nyquist - dc;
         
-        // Copy result back to input
-        for (size_t i = 0; i < size; i++) {
-            real[i] = temp_real[i];
-            imag[i] = temp_imag[i];
+        for (size_t k = 1; k <= BINS / 2; k++) {
+            size_t k2 = BINS - k;
+            
+            T fr = real[k] + real[k2];
+            T fi = imag[k] - imag[k2];
+            T gr = real[k] - real[k2];
+            T gi = imag[k] + imag[k2];
+            
+            // Rotate the difference by the conjugate twiddle
+            T wr, wi;
+            Twiddle(k << SIZE_SHIFT, wr, wi);
+            T hr = wr * gr + wi * gi;
+            T hi = wr * gi - wi * gr;
+            
+            real[k] = fr - hi;
+            imag[k] = -fi - hr;
+            real[k2] = fr + hi;
+            imag[k2] = fi - hr;
         }
     }
     
 private:
-    // Precomputed twiddle factors
-    T twiddles_real_[N / 2];
-    T twiddles_imag_[N / 2];
+    typedef shy_fft_detail::CosineTable<T> Table;
     
-    // Precomputed bit-reversed indices
-    size_t bit_reverse_[N];
+    static const size_t TABLE_BITS = shy_fft_detail::Log2(SHY_FFT_MAX_SIZE);
     
-    // Compute log2(N)
-    constexpr size_t log2N() const {
-        size_t log2n = 0;
-        size_t n = N;
-        while (n > 1) {
-            n >>= 1;
-            log2n++;
-        }
-        return log2n;
-    }
+    // Shift from W_N exponents to shared table indices
+    static const size_t SIZE_SHIFT = TABLE_BITS - shy_fft_detail::Log2(N);
     
-    // Bit-reverse an index
-    size_t BitReverse(size_t index, size_t bits) const {
-        size_t result = 0;
-        for (size_t i = 0; i < bits; i++) {
-            result = (result << 1) | (index & 1);
-            index >>= 1;
-        }
-        return result;
+    // W^k = exp(-2 pi i k / SHY_FFT_MAX_SIZE) for k in the first quadrant
+    static void Twiddle(size_t k, T& re, T& im) {
+        const T* cosine = shy_fft_detail::Tables<T>::cosine.value;
+        re = cosine[k];
+        im = -cosine[Table::QUARTER - k];
     }
 };